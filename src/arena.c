@@ -0,0 +1,70 @@
+#include <windows.h>
+#include <assert.h>
+
+#include "arena.h"
+
+void CreateArena(Arena *arena, size_t reserve)
+{
+	memset(arena, 0, sizeof(Arena));
+	arena->reserved = (reserve + ARENA_COMMIT_SIZE - 1) & ~(size_t)(ARENA_COMMIT_SIZE - 1);
+	arena->base = (u8 *)VirtualAlloc(0, arena->reserved, MEM_RESERVE, PAGE_READWRITE);
+	assert(arena->base != NULL);
+}
+
+void FreeArena(Arena *arena)
+{
+	if (arena->base)
+		VirtualFree(arena->base, 0, MEM_RELEASE);
+	memset(arena, 0, sizeof(Arena));
+}
+
+// keeps the committed pages, the next frame reuses them without faulting
+void ResetArena(Arena *arena)
+{
+	arena->used = 0;
+	arena->num_resets++;
+}
+
+void *ArenaPush(Arena *arena, size_t size)
+{
+	size_t start = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	size_t end = start + size;
+
+	// out of reservation or out of memory to commit, the arena is left as
+	// it was so loaders can back out
+	if (end < start || end > arena->reserved)
+		return NULL;
+
+	if (end > arena->committed) {
+		size_t commit = (end - arena->committed + ARENA_COMMIT_SIZE - 1) & ~(size_t)(ARENA_COMMIT_SIZE - 1);
+		commit = min(commit, arena->reserved - arena->committed);
+		if (!VirtualAlloc(arena->base + arena->committed, commit, MEM_COMMIT, PAGE_READWRITE))
+			return NULL;
+		arena->committed += commit;
+	}
+
+	arena->used = end;
+	arena->peak = max(arena->peak, end);
+	arena->num_allocations++;
+
+	return arena->base + start;
+}
+
+void *ArenaPushZero(Arena *arena, size_t size)
+{
+	void *result = ArenaPush(arena, size);
+	if (result)
+		memset(result, 0, size);
+	return result;
+}
+
+size_t ArenaMark(Arena *arena)
+{
+	return arena->used;
+}
+
+void ArenaRestore(Arena *arena, size_t mark)
+{
+	assert(mark <= arena->used);
+	arena->used = mark;
+}
@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include "types.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_COMMIT_SIZE (64 * 1024)
+
+// linear allocator over one reserved address range, pages are committed
+// as it grows so pointers never move and nothing is freed individually
+typedef struct Arena {
+	u8 *base;
+	size_t reserved;
+	size_t committed;
+	size_t used;
+
+	// stats
+	size_t peak;
+	s64 num_allocations;
+	s64 num_resets;
+} Arena;
+
+void CreateArena(Arena *arena, size_t reserve);
+void FreeArena(Arena *arena);
+void ResetArena(Arena *arena);
+
+// NULL once the reservation is used up or a commit fails
+void *ArenaPush(Arena *arena, size_t size);
+void *ArenaPushZero(Arena *arena, size_t size);
+
+// scratch use: take a mark, push freely, restore to drop everything since
+size_t ArenaMark(Arena *arena);
+void ArenaRestore(Arena *arena, size_t mark);
+
+#define PushStruct(arena, type) ((type *)ArenaPushZero(arena, sizeof(type)))
+#define PushArray(arena, type, count) ((type *)ArenaPush(arena, sizeof(type) * (size_t)(count)))
+
+#endif
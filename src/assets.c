@@ -0,0 +1,120 @@
+#include "assets.h"
+#include "compress.h"
+
+#pragma warning(disable : 4996)
+
+static void LoadModelJob(void *data, s32 worker)
+{
+	Asset *asset = (Asset *)data;
+	asset->result = LoadModelParallel(asset->jobs, asset->path, NULL);
+
+	MemoryBarrier();
+	asset->loaded = true;
+}
+
+static void LoadTextureJob(void *data, s32 worker)
+{
+	Asset *asset = (Asset *)data;
+	Image *image = ReadFromTGA(asset->path, NULL);
+
+	if (image && asset->format != TEXTURE_FORMAT_BGR8) {
+		Image *converted = ConvertImage(image, asset->format, NULL);
+		FreeImage(image);
+		image = converted;
+	}
+
+	if (image && asset->compression != TEXTURE_UNCOMPRESSED && image->format == TEXTURE_FORMAT_BGR8) {
+		Image *compressed = CompressImage(image, asset->compression, NULL);
+		FreeImage(image);
+		image = compressed;
+	}
+
+	asset->result = image;
+
+	MemoryBarrier();
+	asset->loaded = true;
+}
+
+void CreateAssetLoader(AssetLoader *loader, JobSystem *jobs)
+{
+	memset(loader, 0, sizeof(AssetLoader));
+	loader->jobs = jobs;
+}
+
+static void WaitForAsset(AssetLoader *loader, Asset *asset)
+{
+	WaitForJob(loader->jobs, asset->job);
+	assert(asset->loaded);
+}
+
+void DestroyAssetLoader(AssetLoader *loader)
+{
+	for (s32 i = 0; i < loader->num_assets; i++) {
+		Asset *asset = &loader->assets[i];
+		WaitForAsset(loader, asset);
+		if (!asset->result || asset->fetched)
+			continue;
+
+		if (asset->type == ASSET_MODEL)
+			FreeModel((Model *)asset->result);
+		else
+			FreeImage((Image *)asset->result);
+		asset->result = NULL;
+	}
+	loader->num_assets = 0;
+}
+
+static Asset *StartLoad(AssetLoader *loader, AssetType type, const char *file_name, JobFunc func)
+{
+	LONG index = InterlockedIncrement(&loader->num_assets) - 1;
+	assert(index < MAX_ASSETS);
+	assert(strlen(file_name) < MAX_ASSET_PATH);
+
+	Asset *asset = &loader->assets[index];
+	asset->type = type;
+	strcpy(asset->path, file_name);
+	asset->format = TEXTURE_FORMAT_BGR8;
+	asset->compression = TEXTURE_UNCOMPRESSED;
+	asset->loaded = false;
+	asset->result = NULL;
+	asset->fetched = false;
+	asset->jobs = loader->jobs;
+	Job *job = CreateJob(loader->jobs, func, asset);
+	asset->job = GetJobHandle(job);
+	return asset;
+}
+
+Asset *LoadModelAsync(AssetLoader *loader, const char *file_name)
+{
+	Asset *asset = StartLoad(loader, ASSET_MODEL, file_name, LoadModelJob);
+	RunJob(loader->jobs, asset->job.job);
+	return asset;
+}
+
+Asset *LoadTextureAsync(AssetLoader *loader, const char *file_name, TextureFormat format, TextureCompression compression)
+{
+	Asset *asset = StartLoad(loader, ASSET_TEXTURE, file_name, LoadTextureJob);
+	asset->format = format;
+	asset->compression = compression;
+	RunJob(loader->jobs, asset->job.job);
+	return asset;
+}
+
+static void *TakeResult(AssetLoader *loader, Asset *asset)
+{
+	WaitForAsset(loader, asset);
+	asset->fetched = true;
+	return asset->result;
+}
+
+Model *GetModel(AssetLoader *loader, Asset *asset)
+{
+	assert(asset->type == ASSET_MODEL);
+	return (Model *)TakeResult(loader, asset);
+}
+
+Image *GetTexture(AssetLoader *loader, Asset *asset)
+{
+	assert(asset->type == ASSET_TEXTURE);
+	return (Image *)TakeResult(loader, asset);
+}
@@ -0,0 +1,56 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include "types.h"
+
+#include "jobs.h"
+#include "model.h"
+#include "image.h"
+
+#define MAX_ASSETS 256
+#define MAX_ASSET_PATH 260
+
+typedef enum AssetType {
+	ASSET_MODEL,
+	ASSET_TEXTURE,
+} AssetType;
+
+// a handle to a load running on the job system; the result is only
+// touched through GetModel/GetTexture, which wait for it
+typedef struct Asset {
+	AssetType type;
+	char path[MAX_ASSET_PATH];
+
+	// layout conversion done on the worker after decoding
+	TextureFormat format;
+	TextureCompression compression;
+
+	JobSystem *jobs; // loads may split into jobs of their own
+	JobHandle job;
+	volatile LONG loaded; // set once result is complete
+	void *result;
+	b32 fetched; // the caller owns result
+
+} Asset;
+
+// assets are malloc blocks owned by the caller once fetched, arenas are
+// single threaded
+typedef struct AssetLoader {
+	JobSystem *jobs;
+	Asset assets[MAX_ASSETS];
+	volatile LONG num_assets;
+} AssetLoader;
+
+void CreateAssetLoader(AssetLoader *loader, JobSystem *jobs);
+// waits for outstanding loads and frees what nobody fetched
+void DestroyAssetLoader(AssetLoader *loader);
+
+// start loading and return at once
+Asset *LoadModelAsync(AssetLoader *loader, const char *file_name);
+Asset *LoadTextureAsync(AssetLoader *loader, const char *file_name, TextureFormat format, TextureCompression compression);
+
+// block until the asset is loaded and hand it over, NULL if it failed
+Model *GetModel(AssetLoader *loader, Asset *asset);
+Image *GetTexture(AssetLoader *loader, Asset *asset);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef BACKBUFFER_H
+#define BACKBUFFER_H
+
+#include <windows.h>
+
+#include "types.h"
+#include "arena.h"
+
+#define FRAME_ARENA_SIZE ((size_t)256 * 1024 * 1024)
+// reserved on top of FRAME_ARENA_SIZE for passes that need storage per
+// pixel, 4x msaa takes 33 bytes of it
+#define FRAME_SCRATCH_PER_PIXEL 48
+
+typedef enum DepthTest {
+	DEPTH_TEST_GREATER, // nearer than anything drawn so far
+	DEPTH_TEST_EQUAL, // after a z prepass, only the visible surface shades
+} DepthTest;
+
+typedef struct Backbuffer {
+	s32 width;
+	s32 height;
+	void *memory;
+	BITMAPINFO bitmapInfo;
+	f32 *zbuffer;
+
+	// Draw only touches [clip_x0, clip_x1) x [clip_y0, clip_y1), the whole
+	// buffer unless SetClipRect narrowed it
+	s32 clip_x0, clip_y0;
+	s32 clip_x1, clip_y1;
+	DepthTest depth_test;
+
+	// transient per-frame data, reset by ClearBackbuffer
+	Arena scratch;
+} Backbuffer;
+
+void CreateBackbuffer(Backbuffer *buffer, s32 width, s32 height);
+void FreeBackbuffer(Backbuffer *buffer);
+void ClearBackbuffer(Backbuffer *buffer);
+
+void SetClipRect(Backbuffer *buffer, s32 x0, s32 y0, s32 x1, s32 y1);
+void ResetClipRect(Backbuffer *buffer);
+
+#endif
@@ -0,0 +1,38 @@
+#include "batch.h"
+
+typedef struct BatchState {
+	RenderBatch *batch;
+	Backbuffer buffers[MAX_WORKERS];
+} BatchState;
+
+// a worker renders every view it picks up into the same framebuffer
+static void RenderViewRange(void *data, s32 start, s32 end, s32 worker)
+{
+	BatchState *state = (BatchState *)data;
+	RenderBatch *batch = state->batch;
+	Backbuffer *buffer = &state->buffers[worker];
+
+	if (!buffer->memory)
+		CreateBackbuffer(buffer, batch->width, batch->height);
+
+	for (s32 view = start; view < end; view++) {
+		RenderScene(buffer, batch->scene, &batch->cameras[view]);
+		if (batch->view_done)
+			batch->view_done(buffer, view, batch->user_data);
+	}
+}
+
+void RenderViews(JobSystem *jobs, RenderBatch *batch)
+{
+	BatchState *state = (BatchState *)calloc(1, sizeof(BatchState));
+	state->batch = batch;
+
+	// every view samples the same page table, so it is settled up front
+	UpdateSceneTextures(batch->scene);
+
+	ParallelFor(jobs, batch->num_views, 1, RenderViewRange, state);
+
+	for (s32 i = 0; i < MAX_WORKERS; i++)
+		FreeBackbuffer(&state->buffers[i]);
+	free(state);
+}
@@ -0,0 +1,26 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "types.h"
+
+#include "backbuffer.h"
+#include "scene.h"
+#include "jobs.h"
+
+// called on a worker thread as soon as a view is rendered; the buffer
+// belongs to that worker and is reused for its next view after this returns
+typedef void (*ViewFunc)(Backbuffer *buffer, s32 view, void *user_data);
+
+typedef struct RenderBatch {
+	Scene *scene;
+	Camera *cameras;
+	s32 num_views;
+	s32 width;
+	s32 height;
+	ViewFunc view_done;
+	void *user_data;
+} RenderBatch;
+
+void RenderViews(JobSystem *jobs, RenderBatch *batch);
+
+#endif
@@ -0,0 +1,364 @@
+#include "cluster.h"
+
+#pragma warning(disable : 4996)
+
+#define CLUSTER_HEADER_SIZE ((sizeof(ClusterShared) + 63) & ~(size_t)63)
+#define CLUSTER_SECTION_SIZE (CLUSTER_HEADER_SIZE + (size_t)MAX_CLUSTER_SIZE * MAX_CLUSTER_SIZE * sizeof(u32))
+
+static void EventName(char *event_name, size_t size, const char *name, const char *kind, s32 index)
+{
+	snprintf(event_name, size, "%s_%s%d", name, kind, index);
+}
+
+static void SplitEvenly(s32 *band_start, s32 num_bands, s32 height)
+{
+	for (s32 i = 0; i <= num_bands; i++)
+		band_start[i] = (s32)((s64)height * i / num_bands);
+}
+
+// the rows are cut so every band's share of last frame's cost is the same,
+// taking the cost of each band as spread evenly over its rows; the bands
+// only move part of the way there, a single slow frame would swing them
+static void BalanceBands(RenderCluster *cluster, s32 height)
+{
+	ClusterShared *shared = cluster->shared;
+	s32 *band_start = shared->frame.band_start;
+	s32 num_bands = cluster->num_workers;
+
+	f32 density[MAX_CLUSTER_WORKERS];
+	f32 total_ms = 0.0f, slowest_ms = 0.0f;
+	for (s32 i = 0; i < num_bands; i++) {
+		f32 ms = max(shared->workers[i].render_ms, 0.01f);
+		density[i] = ms / max(band_start[i + 1] - band_start[i], 1);
+		total_ms += ms;
+		slowest_ms = max(slowest_ms, ms);
+	}
+	cluster->imbalance = slowest_ms * num_bands / total_ms;
+
+	s32 balanced[MAX_CLUSTER_WORKERS + 1];
+	balanced[0] = 0;
+	balanced[num_bands] = height;
+	s32 band = 0;
+	f32 cost = 0.0f;
+	for (s32 i = 1; i < num_bands; i++) {
+		f32 target = total_ms * i / num_bands;
+		while (band < num_bands - 1 && cost + density[band] * (band_start[band + 1] - band_start[band]) < target) {
+			cost += density[band] * (band_start[band + 1] - band_start[band]);
+			band++;
+		}
+		f32 row = band_start[band] + (target - cost) / density[band];
+		balanced[i] = (s32)min(row, (f32)band_start[band + 1]);
+	}
+
+	s32 min_rows = min(MIN_BAND_ROWS, height / num_bands);
+	for (s32 i = 1; i < num_bands; i++) {
+		s32 start = band_start[i] + (s32)(CLUSTER_BALANCE_RATE * (balanced[i] - band_start[i]));
+		start = max(start, band_start[i - 1] + min_rows);
+		band_start[i] = min(start, height - (num_bands - i) * min_rows);
+	}
+}
+
+// waits for worker i to signal, false if its process went away instead
+static b32 WaitForWorker(RenderCluster *cluster, s32 i)
+{
+	HANDLE handles[2] = { cluster->frame_done[i], cluster->processes[i] };
+	return WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0;
+}
+
+b32 StartRenderCluster(RenderCluster *cluster, s32 num_workers, ClusterAssets *assets)
+{
+	static volatile LONG clusters_started;
+
+	assert(num_workers > 0 && num_workers <= MAX_CLUSTER_WORKERS);
+	memset(cluster, 0, sizeof(RenderCluster));
+	cluster->num_workers = num_workers;
+	snprintf(cluster->name, sizeof(cluster->name), "Local\\renderer_cluster_%lu_%ld",
+		GetCurrentProcessId(), InterlockedIncrement(&clusters_started));
+
+	cluster->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)((u64)CLUSTER_SECTION_SIZE >> 32), (DWORD)CLUSTER_SECTION_SIZE, cluster->name);
+	if (!cluster->mapping)
+		return false;
+	cluster->shared = (ClusterShared *)MapViewOfFile(cluster->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!cluster->shared) {
+		CloseHandle(cluster->mapping);
+		return false;
+	}
+	cluster->colour = (u32 *)((u8 *)cluster->shared + CLUSTER_HEADER_SIZE);
+
+	ClusterShared *shared = cluster->shared;
+	shared->coordinator = GetCurrentProcessId();
+	shared->assets = *assets;
+
+	char executable[MAX_PATH];
+	GetModuleFileNameA(NULL, executable, MAX_PATH);
+
+	b32 ok = true;
+	for (s32 i = 0; i < num_workers; i++) {
+		char event_name[128];
+		EventName(event_name, sizeof(event_name), cluster->name, "ready", i);
+		cluster->frame_ready[i] = CreateEventA(NULL, FALSE, FALSE, event_name);
+		EventName(event_name, sizeof(event_name), cluster->name, "done", i);
+		cluster->frame_done[i] = CreateEventA(NULL, FALSE, FALSE, event_name);
+
+		char command_line[MAX_PATH + 128];
+		snprintf(command_line, sizeof(command_line), "\"%s\" --cluster-worker %s %d", executable, cluster->name, i);
+		STARTUPINFOA startup = { sizeof(STARTUPINFOA) };
+		PROCESS_INFORMATION process;
+		ok = ok && cluster->frame_ready[i] && cluster->frame_done[i] &&
+			CreateProcessA(NULL, command_line, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &process);
+		if (!ok)
+			break;
+		CloseHandle(process.hThread);
+		cluster->processes[i] = process.hProcess;
+	}
+
+	// every worker signals once its assets are loaded, or exits
+	for (s32 i = 0; ok && i < num_workers; i++)
+		ok = WaitForWorker(cluster, i) && shared->workers[i].loaded;
+
+	if (!ok) {
+		StopRenderCluster(cluster);
+		return false;
+	}
+	return true;
+}
+
+void StopRenderCluster(RenderCluster *cluster)
+{
+	InterlockedExchange(&cluster->shared->quit, 1);
+	for (s32 i = 0; i < cluster->num_workers; i++) {
+		if (cluster->processes[i]) {
+			SetEvent(cluster->frame_ready[i]);
+			WaitForSingleObject(cluster->processes[i], INFINITE);
+			CloseHandle(cluster->processes[i]);
+		}
+		if (cluster->frame_ready[i])
+			CloseHandle(cluster->frame_ready[i]);
+		if (cluster->frame_done[i])
+			CloseHandle(cluster->frame_done[i]);
+	}
+
+	UnmapViewOfFile(cluster->shared);
+	CloseHandle(cluster->mapping);
+	memset(cluster, 0, sizeof(RenderCluster));
+}
+
+b32 RenderClusterFrame(RenderCluster *cluster, Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	ClusterShared *shared = cluster->shared;
+	ClusterFrame *frame = &shared->frame;
+	if (buffer->width > MAX_CLUSTER_SIZE || buffer->height > MAX_CLUSTER_SIZE)
+		return false;
+
+	if (buffer->width != frame->width || buffer->height != frame->height)
+		SplitEvenly(frame->band_start, cluster->num_workers, buffer->height);
+	frame->frame = ++cluster->frames;
+	frame->width = buffer->width;
+	frame->height = buffer->height;
+	frame->camera = *camera;
+	frame->light = scene->light;
+	frame->quality = scene->quality;
+	frame->shadows = scene->shadow_map != NULL;
+	frame->baked_lighting = scene->lighting_cache != NULL;
+
+	// the events order the writes above before the workers read them, and
+	// their pixels before the copy below
+	for (s32 i = 0; i < cluster->num_workers; i++)
+		SetEvent(cluster->frame_ready[i]);
+	b32 ok = true;
+	for (s32 i = 0; i < cluster->num_workers; i++)
+		ok = WaitForWorker(cluster, i) && ok;
+	if (!ok)
+		return false;
+
+	memcpy(buffer->memory, cluster->colour, (s64)buffer->width * buffer->height * sizeof(u32));
+	BalanceBands(cluster, buffer->height);
+	return true;
+}
+
+// sort first: faces whose rows on screen all miss the band are dropped
+// before any vertex shading, the rest go through Draw clipped to it
+static s32 DrawBand(Backbuffer *buffer, Scene *scene, Camera *camera, s32 y0, s32 y1)
+{
+	Varyings varyings;
+	Uniforms uniforms;
+	Program program;
+	program.varyings = &varyings;
+	program.uniforms = &uniforms;
+
+	SetupUniforms(&uniforms, scene, camera);
+	program.num_varyings = NumVaryings(&uniforms);
+
+	mat4 viewport = Viewport(0, 0, buffer->width, buffer->height);
+	Model *model = scene->model;
+	s32 drawn = 0;
+
+	for (s32 i = 0; i < model->num_faces; i++) {
+		f32 min_y = (f32)y1, max_y = (f32)y0 - 1.0f;
+		b32 behind = false;
+		for (s32 j = 0; j < 3; j++) {
+			vec4 clip_coord = Mat4MultiplyVec4(uniforms.mvp, Vec4(model->positions[i * 3 + j], 1.0f));
+			behind = behind || clip_coord.w <= 0.0f;
+			vec4 coord = Vec4f(clip_coord.x / clip_coord.w, clip_coord.y / clip_coord.w, clip_coord.z / clip_coord.w, 1.0f);
+			f32 y = Mat4MultiplyVec4(viewport, coord).y;
+			min_y = min(min_y, y);
+			max_y = max(max_y, y);
+		}
+		// Draw covers rows up to but not including the truncated max, so
+		// these can not touch the band
+		if (!behind && (max_y < (f32)y0 || min_y >= (f32)y1))
+			continue;
+
+		DrawFaces(buffer, &program, viewport, model, i, 1);
+		drawn++;
+	}
+	return drawn;
+}
+
+// the same load the coordinator made, from the worker's own files; virtual
+// maps load their pages as they are sampled, there are no workers to ask
+static b32 LoadClusterScene(Scene *scene, ClusterAssets *assets, VirtualTexture *virtual_maps)
+{
+	scene->model = LoadModel(assets->model_path, &scene->arena);
+	if (scene->model && assets->reorder)
+		scene->model = ReorderModel(scene->model, assets->sort_clusters, NULL, &scene->arena);
+
+	Image *maps[3] = { 0 };
+	for (s32 i = 0; i < 3; i++) {
+		if (assets->virtual_maps) {
+			if (OpenVirtualTexture(&virtual_maps[i], assets->map_paths[i], NULL))
+				maps[i] = &virtual_maps[i].image;
+			continue;
+		}
+
+		maps[i] = ReadFromTGA(assets->map_paths[i], &scene->arena);
+		if (maps[i] && assets->map_formats[i] != TEXTURE_FORMAT_BGR8)
+			maps[i] = ConvertImage(maps[i], assets->map_formats[i], &scene->arena);
+		if (maps[i] && assets->map_compressions[i] != TEXTURE_UNCOMPRESSED && maps[i]->format == TEXTURE_FORMAT_BGR8)
+			maps[i] = CompressImage(maps[i], assets->map_compressions[i], &scene->arena);
+	}
+	scene->diffuse_map = maps[0];
+	scene->normal_map = maps[1];
+	scene->specular_map = maps[2];
+	return scene->model && maps[0] && maps[1] && maps[2];
+}
+
+s32 RunClusterWorker(const char *name, s32 index)
+{
+	if (index < 0 || index >= MAX_CLUSTER_WORKERS)
+		return 1;
+
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+	if (!mapping)
+		return 1;
+	ClusterShared *shared = (ClusterShared *)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!shared) {
+		CloseHandle(mapping);
+		return 1;
+	}
+	u32 *colour = (u32 *)((u8 *)shared + CLUSTER_HEADER_SIZE);
+
+	char event_name[128];
+	EventName(event_name, sizeof(event_name), name, "ready", index);
+	HANDLE frame_ready = OpenEventA(EVENT_ALL_ACCESS, FALSE, event_name);
+	EventName(event_name, sizeof(event_name), name, "done", index);
+	HANDLE frame_done = OpenEventA(EVENT_ALL_ACCESS, FALSE, event_name);
+	HANDLE coordinator = OpenProcess(SYNCHRONIZE, FALSE, shared->coordinator);
+
+	ClusterWorkerStatus *status = &shared->workers[index];
+	if (!frame_ready || !frame_done || !coordinator) {
+		UnmapViewOfFile(shared);
+		CloseHandle(mapping);
+		return 1;
+	}
+
+	Scene scene;
+	memset(&scene, 0, sizeof(Scene));
+	CreateArena(&scene.arena, (size_t)1024 * 1024 * 1024);
+	ClusterAssets *assets = &shared->assets;
+	VirtualTexture virtual_maps[3];
+	status->loaded = LoadClusterScene(&scene, assets, virtual_maps);
+	SetEvent(frame_done);
+
+	// the colour rows are the shared ones, only depth is the worker's own
+	Backbuffer buffer;
+	memset(&buffer, 0, sizeof(Backbuffer));
+	buffer.memory = colour;
+	buffer.depth_test = DEPTH_TEST_GREATER;
+	ShadowMap shadow_map;
+	b32 has_shadow_map = false;
+	LightingCache lighting_cache;
+	b32 has_lighting_cache = false;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	while (status->loaded) {
+		HANDLE handles[2] = { frame_ready, coordinator };
+		if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0 || shared->quit)
+			break;
+
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+
+		ClusterFrame frame = shared->frame;
+		if (frame.width != buffer.width || frame.height != buffer.height) {
+			if (buffer.zbuffer)
+				VirtualFree(buffer.zbuffer, 0, MEM_RELEASE);
+			buffer.zbuffer = (f32 *)VirtualAlloc(0, (s64)frame.width * frame.height * sizeof(f32), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			buffer.width = frame.width;
+			buffer.height = frame.height;
+		}
+
+		s32 y0 = frame.band_start[index], y1 = frame.band_start[index + 1];
+		s64 row_offset = (s64)y0 * frame.width;
+		s64 band_pixels = (s64)(y1 - y0) * frame.width;
+		memset(colour + row_offset, 0, band_pixels * sizeof(u32));
+		memset(buffer.zbuffer + row_offset, 0, band_pixels * sizeof(f32));
+		SetClipRect(&buffer, 0, y0, frame.width, y1);
+
+		if (frame.shadows && !has_shadow_map) {
+			CreateShadowMap(&shadow_map, SHADOW_MAP_SIZE);
+			has_shadow_map = true;
+		}
+		if (frame.baked_lighting && !has_lighting_cache) {
+			CreateLightingCache(&lighting_cache);
+			has_lighting_cache = true;
+		}
+		scene.shadow_map = frame.shadows ? &shadow_map : NULL;
+		scene.lighting_cache = frame.baked_lighting ? &lighting_cache : NULL;
+		scene.light = frame.light;
+		scene.quality = frame.quality;
+		// this process is the only one sampling its pages
+		UpdateSceneTextures(&scene);
+		status->faces_drawn = DrawBand(&buffer, &scene, &frame.camera, y0, y1);
+
+		QueryPerformanceCounter(&end);
+		status->render_ms = (f32)((end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart);
+		status->frame = frame.frame;
+		SetEvent(frame_done);
+	}
+
+	if (buffer.zbuffer)
+		VirtualFree(buffer.zbuffer, 0, MEM_RELEASE);
+	// assets that did load are all in the arena, or in the page caches
+	Image *maps[3] = { scene.diffuse_map, scene.normal_map, scene.specular_map };
+	for (s32 i = 0; assets->virtual_maps && i < 3; i++) {
+		if (maps[i])
+			CloseVirtualTexture(&virtual_maps[i]);
+	}
+	scene.shadow_map = has_shadow_map ? &shadow_map : NULL;
+	scene.lighting_cache = has_lighting_cache ? &lighting_cache : NULL;
+	if (status->loaded)
+		FreeScene(&scene);
+	else
+		FreeArena(&scene.arena);
+
+	CloseHandle(coordinator);
+	CloseHandle(frame_ready);
+	CloseHandle(frame_done);
+	UnmapViewOfFile(shared);
+	CloseHandle(mapping);
+	return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <windows.h>
+#include <assert.h>
+#include <string.h>
+
+#include "types.h"
+#include "maths.h"
+
+#include "backbuffer.h"
+#include "scene.h"
+#include "assets.h"
+#include "reorder.h"
+#include "compress.h"
+
+#define MAX_CLUSTER_WORKERS 16
+#define MAX_CLUSTER_SIZE 4096 // widest and tallest frame the section holds
+#define MIN_BAND_ROWS 8
+#define CLUSTER_BALANCE_RATE 0.5f // how far bands move toward the balanced split each frame
+
+// everything a worker needs to render its band, written by the coordinator
+// before it signals the frame. rows [band_start[i], band_start[i + 1]) are
+// worker i's
+typedef struct ClusterFrame {
+	s64 frame;
+	s32 width, height;
+	Camera camera;
+	vec3 light;
+	ShadingQuality quality;
+	b32 shadows;
+	b32 baked_lighting;
+	s32 band_start[MAX_CLUSTER_WORKERS + 1];
+} ClusterFrame;
+
+// written by a worker before it signals its band done
+typedef struct ClusterWorkerStatus {
+	b32 loaded;
+	s64 frame;
+	f32 render_ms;
+	s32 faces_drawn; // left after culling to the band
+} ClusterWorkerStatus;
+
+// how the coordinator loaded its scene, which every worker repeats with its
+// own copy so the bands match what the coordinator would render itself;
+// map_paths name page files when virtual_maps is set
+typedef struct ClusterAssets {
+	char model_path[MAX_ASSET_PATH];
+	char map_paths[3][MAX_ASSET_PATH];
+	TextureFormat map_formats[3];
+	TextureCompression map_compressions[3];
+	b32 virtual_maps;
+	b32 reorder; // as ReorderModel, sorting the clusters too if sort_clusters
+	b32 sort_clusters;
+} ClusterAssets;
+
+// the head of the shared section, the colour buffer follows it. a
+// ClusterFrame going out and a band of pixel rows coming back are all that
+// cross between processes, so another transport only has to carry those
+typedef struct ClusterShared {
+	DWORD coordinator; // process id, workers exit with it
+	volatile LONG quit;
+	ClusterAssets assets;
+
+	ClusterFrame frame;
+	ClusterWorkerStatus workers[MAX_CLUSTER_WORKERS];
+} ClusterShared;
+
+// sort first rendering across processes: each worker owns a band of rows
+// of the frame, culls the model to it and renders it straight into the
+// shared colour buffer; band boundaries follow the previous frame's
+// per-band times so the slowest worker sets the pace as little as possible
+typedef struct RenderCluster {
+	s32 num_workers;
+	char name[64];
+	HANDLE mapping;
+	ClusterShared *shared;
+	u32 *colour;
+
+	HANDLE processes[MAX_CLUSTER_WORKERS];
+	HANDLE frame_ready[MAX_CLUSTER_WORKERS];
+	HANDLE frame_done[MAX_CLUSTER_WORKERS];
+
+	// stats
+	s64 frames;
+	f32 imbalance; // slowest band's time over the mean, last frame
+} RenderCluster;
+
+// starts num_workers copies of this executable, each loading the model and
+// maps itself as assets describes; false if any of them fails to
+b32 StartRenderCluster(RenderCluster *cluster, s32 num_workers, ClusterAssets *assets);
+void StopRenderCluster(RenderCluster *cluster);
+
+// the scene's light, quality and shadow map and lighting cache switches go
+// out with the camera, its assets are the ones the workers loaded; false if
+// the frame is larger than the section or a worker has gone, buffer is
+// untouched then
+b32 RenderClusterFrame(RenderCluster *cluster, Backbuffer *buffer, Scene *scene, Camera *camera);
+
+// the body of a worker process, until the coordinator quits or exits
+s32 RunClusterWorker(const char *name, s32 index);
+
+#endif
@@ -0,0 +1,266 @@
+#include "compress.h"
+
+typedef struct DecodedBlock {
+	u32 generation; // of the image, never 0, so empty entries never match
+	s32 block;
+	u32 texels[16]; // 0xAARRGGBB
+} DecodedBlock;
+
+static __declspec(thread) DecodedBlock block_cache[BLOCK_CACHE_SIZE];
+
+static s32 BlockSize(TextureCompression compression)
+{
+	return compression == TEXTURE_BC3 ? 16 : 8;
+}
+
+s64 ImageSize(Image *image)
+{
+	if (image->compression == TEXTURE_UNCOMPRESSED)
+		return (s64)image->width * image->height * image->channels;
+	s64 num_blocks = (s64)((image->width + 3) / 4) * ((image->height + 3) / 4);
+	return num_blocks * BlockSize(image->compression);
+}
+
+static u16 PackRGB565(f32 r, f32 g, f32 b)
+{
+	s32 r5 = (s32)(max(0.0f, min(255.0f, r)) * 31.0f / 255.0f + 0.5f);
+	s32 g6 = (s32)(max(0.0f, min(255.0f, g)) * 63.0f / 255.0f + 0.5f);
+	s32 b5 = (s32)(max(0.0f, min(255.0f, b)) * 31.0f / 255.0f + 0.5f);
+	return (u16)((r5 << 11) | (g6 << 5) | b5);
+}
+
+static void UnpackRGB565(u16 colour, s32 rgb[3])
+{
+	s32 r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+static void ColourPalette(u16 colour0, u16 colour1, s32 palette[4][3])
+{
+	UnpackRGB565(colour0, palette[0]);
+	UnpackRGB565(colour1, palette[1]);
+	for (s32 c = 0; c < 3; c++) {
+		if (colour0 > colour1) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+// endpoints along the block's principal axis, found by a few rounds of
+// power iteration on the colour covariance
+static void EncodeColourBlock(u8 *block, s32 texels[16][4])
+{
+	f32 mean[3] = { 0 };
+	for (s32 i = 0; i < 16; i++) {
+		for (s32 c = 0; c < 3; c++)
+			mean[c] += texels[i][c] / 16.0f;
+	}
+
+	f32 covariance[6] = { 0 };
+	for (s32 i = 0; i < 16; i++) {
+		f32 r = texels[i][0] - mean[0], g = texels[i][1] - mean[1], b = texels[i][2] - mean[2];
+		covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+		covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+	}
+
+	f32 axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (s32 iteration = 0; iteration < 4; iteration++) {
+		f32 x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		f32 y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		f32 z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		f32 length = max(max(fabsf(x), fabsf(y)), fabsf(z));
+		if (length == 0.0f)
+			break;
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	f32 lower = FLT_MAX, upper = -FLT_MAX;
+	for (s32 i = 0; i < 16; i++) {
+		f32 t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+		lower = min(lower, t);
+		upper = max(upper, t);
+	}
+	f32 length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	if (length > 0.0f) {
+		lower /= length;
+		upper /= length;
+	}
+
+	u16 colour0 = PackRGB565(mean[0] + axis[0] * upper, mean[1] + axis[1] * upper, mean[2] + axis[2] * upper);
+	u16 colour1 = PackRGB565(mean[0] + axis[0] * lower, mean[1] + axis[1] * lower, mean[2] + axis[2] * lower);
+	if (colour0 < colour1) {
+		u16 swap = colour0;
+		colour0 = colour1;
+		colour1 = swap;
+	}
+
+	// equal endpoints land in three colour mode, index 0 still decodes right
+	s32 palette[4][3];
+	ColourPalette(colour0, colour1, palette);
+	s32 num_colours = colour0 > colour1 ? 4 : 3;
+
+	u32 indices = 0;
+	for (s32 i = 0; i < 16; i++) {
+		s32 best = 0, best_error = 0x7FFFFFFF;
+		for (s32 p = 0; p < num_colours; p++) {
+			s32 dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+			s32 error = dr * dr + dg * dg + db * db;
+			if (error < best_error) {
+				best_error = error;
+				best = p;
+			}
+		}
+		indices |= (u32)best << (i * 2);
+	}
+
+	block[0] = colour0 & 0xFF;
+	block[1] = colour0 >> 8;
+	block[2] = colour1 & 0xFF;
+	block[3] = colour1 >> 8;
+	block[4] = indices & 0xFF;
+	block[5] = (indices >> 8) & 0xFF;
+	block[6] = (indices >> 16) & 0xFF;
+	block[7] = indices >> 24;
+}
+
+static void AlphaPalette(s32 alpha0, s32 alpha1, s32 palette[8])
+{
+	palette[0] = alpha0;
+	palette[1] = alpha1;
+	for (s32 i = 1; i < 7; i++)
+		palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+}
+
+static void EncodeAlphaBlock(u8 *block, s32 texels[16][4])
+{
+	s32 alpha0 = 0, alpha1 = 255;
+	for (s32 i = 0; i < 16; i++) {
+		alpha0 = max(alpha0, texels[i][3]);
+		alpha1 = min(alpha1, texels[i][3]);
+	}
+
+	s32 palette[8];
+	AlphaPalette(alpha0, alpha1, palette);
+
+	u64 indices = 0;
+	for (s32 i = 0; i < 16; i++) {
+		s32 best = 0;
+		for (s32 p = 1; p < 8; p++) {
+			if (abs(texels[i][3] - palette[p]) < abs(texels[i][3] - palette[best]))
+				best = p;
+		}
+		indices |= (u64)best << (i * 3);
+	}
+
+	block[0] = (u8)alpha0;
+	block[1] = (u8)alpha1;
+	for (s32 i = 0; i < 6; i++)
+		block[2 + i] = (u8)(indices >> (i * 8));
+}
+
+Image *CompressImage(Image *image, TextureCompression compression, Arena *arena)
+{
+	assert(image->compression == TEXTURE_UNCOMPRESSED && image->format == TEXTURE_FORMAT_BGR8 && !image->virtual_texture);
+
+	s32 blocks_x = (image->width + 3) / 4;
+	s32 blocks_y = (image->height + 3) / 4;
+	s32 block_size = BlockSize(compression);
+	size_t buffer_size = (size_t)blocks_x * blocks_y * block_size;
+
+	// header and blocks share one allocation, as in ReadFromTGA
+	size_t header_size = (sizeof(Image) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	u8 *memory = arena ? (u8 *)ArenaPushZero(arena, header_size + buffer_size) : (u8 *)calloc(1, header_size + buffer_size);
+
+	Image *result = (Image *)memory;
+	result->width = image->width;
+	result->height = image->height;
+	result->channels = image->channels;
+	result->buffer = memory + header_size;
+	result->in_arena = arena != NULL;
+	result->compression = compression;
+	result->format = TEXTURE_FORMAT_BGR8;
+	TouchImage(result);
+
+	for (s32 by = 0; by < blocks_y; by++) {
+		for (s32 bx = 0; bx < blocks_x; bx++) {
+			// edge blocks repeat the last row and column; single channel
+			// images go in as grey
+			s32 texels[16][4];
+			for (s32 i = 0; i < 16; i++) {
+				s32 x = min(bx * 4 + (i & 3), image->width - 1);
+				s32 y = min(by * 4 + (i >> 2), image->height - 1);
+				u8 *pixel = &image->buffer[((s64)y * image->width + x) * image->channels];
+				texels[i][2] = pixel[0];
+				texels[i][1] = image->channels >= 3 ? pixel[1] : pixel[0];
+				texels[i][0] = image->channels >= 3 ? pixel[2] : pixel[0];
+				texels[i][3] = image->channels == 4 ? pixel[3] : 255;
+			}
+
+			u8 *block = result->buffer + ((s64)by * blocks_x + bx) * block_size;
+			if (compression == TEXTURE_BC3) {
+				EncodeAlphaBlock(block, texels);
+				block += 8;
+			}
+			EncodeColourBlock(block, texels);
+		}
+	}
+
+	return result;
+}
+
+static void DecodeBlock(Image *image, s32 index, u32 texels[16])
+{
+	u8 *block = image->buffer + (s64)index * BlockSize(image->compression);
+	s32 alphas[8] = { 255, 255, 255, 255, 255, 255, 255, 255 };
+	u64 alpha_indices = 0;
+
+	if (image->compression == TEXTURE_BC3) {
+		AlphaPalette(block[0], block[1], alphas);
+		for (s32 i = 0; i < 6; i++)
+			alpha_indices |= (u64)block[2 + i] << (i * 8);
+		block += 8;
+	}
+
+	s32 palette[4][3];
+	u16 colour0 = block[0] | (block[1] << 8);
+	u16 colour1 = block[2] | (block[3] << 8);
+	u32 indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((u32)block[7] << 24);
+	ColourPalette(colour0, colour1, palette);
+
+	for (s32 i = 0; i < 16; i++) {
+		s32 *colour = palette[(indices >> (i * 2)) & 3];
+		u32 alpha = (u32)alphas[(alpha_indices >> (i * 3)) & 7];
+		texels[i] = (alpha << 24) | ((u32)colour[0] << 16) | ((u32)colour[1] << 8) | (u32)colour[2];
+	}
+}
+
+vec3 GetCompressedColour(Image *image, s32 x, s32 y)
+{
+	s32 blocks_x = (image->width + 3) / 4;
+	s32 index = (y >> 2) * blocks_x + (x >> 2);
+
+	// direct mapped on the block index, so neighbouring blocks never
+	// collide; the scrambled generation keeps maps sampled together apart.
+	// keyed on the generation rather than the address, which a freed
+	// image can hand on to the next one
+	u32 salt = image->generation * 2654435761u;
+	DecodedBlock *cached = &block_cache[((u32)index ^ (salt >> 16)) & (BLOCK_CACHE_SIZE - 1)];
+	if (cached->generation != image->generation || cached->block != index) {
+		DecodeBlock(image, index, cached->texels);
+		cached->generation = image->generation;
+		cached->block = index;
+	}
+
+	u32 texel = cached->texels[((y & 3) << 2) | (x & 3)];
+	vec3 colour;
+	colour.r = (f32)((texel >> 16) & 0xFF);
+	colour.g = (f32)((texel >> 8) & 0xFF);
+	colour.b = (f32)(texel & 0xFF);
+	return colour;
+}
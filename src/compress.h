@@ -0,0 +1,25 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <float.h>
+
+#include "types.h"
+#include "maths.h"
+
+#include "arena.h"
+#include "image.h"
+
+#define BLOCK_CACHE_SIZE 1024 // decoded blocks kept per thread
+
+// copies image into 4x4 block storage; 4 channel images keep alpha with
+// bc3, the others use bc1. with a NULL arena the result is one malloc
+// block released by FreeImage
+Image *CompressImage(Image *image, TextureCompression compression, Arena *arena);
+
+// texel x, y as GetColour would return it, through the calling thread's
+// cache of decoded blocks
+vec3 GetCompressedColour(Image *image, s32 x, s32 y);
+
+s64 ImageSize(Image *image);
+
+#endif
@@ -1,12 +1,5 @@
 #include "draw.h"
 
-static void Swap(f32 *xp, f32 *yp)
-{
-	f32 temp = *xp;
-	*xp = *yp;
-	*yp = temp;
-}
-
 static void DrawPixel(Backbuffer *buffer, s32 x, s32 y, vec3 colour)
 {
 	if (x < 0 || y < 0 || x >= buffer->width || y >= buffer->height)
@@ -16,39 +9,93 @@ static void DrawPixel(Backbuffer *buffer, s32 x, s32 y, vec3 colour)
 	*pixel = (((s32)colour.r << 16) | ((s32)colour.g << 8) | (s32)colour.b);
 }
 
-static void DrawLine(Backbuffer *buffer, vec2 v0, vec2 v1, vec3 colour)
+// cohen-sutherland outcodes against the clip rect, inclusive edges
+#define OUTSIDE_LEFT 1
+#define OUTSIDE_RIGHT 2
+#define OUTSIDE_BOTTOM 4
+#define OUTSIDE_TOP 8
+
+static s32 OutCode(f32 x, f32 y, f32 x_min, f32 y_min, f32 x_max, f32 y_max)
 {
-	s32 dx = abs(v1.x - v0.x);
-	s32 dy = abs(v1.y - v0.y);
+	s32 code = 0;
+	if (x < x_min)
+		code |= OUTSIDE_LEFT;
+	else if (x > x_max)
+		code |= OUTSIDE_RIGHT;
+	if (y < y_min)
+		code |= OUTSIDE_BOTTOM;
+	else if (y > y_max)
+		code |= OUTSIDE_TOP;
+	return code;
+}
 
-	if (dx > dy) {
-		if (v0.x > v1.x) {
-			Swap(&v0.x, &v1.x);
-			Swap(&v0.y, &v1.y);
-		}
-		for (s32 x = v0.x; x <= v1.x; x++) {
-			f32 t = (x - v0.x) / (v1.x - v0.x);
-			s32 y = (s32)(v0.y + (v1.y - v0.y) * t);
-			DrawPixel(buffer, x, y, colour);
-		}
-	} else {
-		if (v0.y > v1.y) {
-			Swap(&v0.y, &v1.y);
-			Swap(&v0.x, &v1.x);
+b32 ClipLine(Backbuffer *buffer, vec2 *v0, vec2 *v1)
+{
+	f32 x_min = (f32)buffer->clip_x0, y_min = (f32)buffer->clip_y0;
+	f32 x_max = (f32)buffer->clip_x1 - 1.0f, y_max = (f32)buffer->clip_y1 - 1.0f;
+	s32 code0 = OutCode(v0->x, v0->y, x_min, y_min, x_max, y_max);
+	s32 code1 = OutCode(v1->x, v1->y, x_min, y_min, x_max, y_max);
+
+	while (code0 | code1) {
+		if (code0 & code1)
+			return false;
+
+		// move the outside end onto the edge it crosses
+		s32 code = code0 ? code0 : code1;
+		f32 x, y;
+		if (code & OUTSIDE_TOP) {
+			x = v0->x + (v1->x - v0->x) * (y_max - v0->y) / (v1->y - v0->y);
+			y = y_max;
+		} else if (code & OUTSIDE_BOTTOM) {
+			x = v0->x + (v1->x - v0->x) * (y_min - v0->y) / (v1->y - v0->y);
+			y = y_min;
+		} else if (code & OUTSIDE_RIGHT) {
+			y = v0->y + (v1->y - v0->y) * (x_max - v0->x) / (v1->x - v0->x);
+			x = x_max;
+		} else {
+			y = v0->y + (v1->y - v0->y) * (x_min - v0->x) / (v1->x - v0->x);
+			x = x_min;
 		}
-		for (s32 y = v0.y; y <= v1.y; y++) {
-			f32 t = (y - v0.y) / (v1.y - v0.y);
-			s32 x = (s32)(v0.x + (v1.x - v0.x) * t);
-			DrawPixel(buffer, x, y, colour);
+
+		if (code == code0) {
+			*v0 = Vec2f(x, y);
+			code0 = OutCode(x, y, x_min, y_min, x_max, y_max);
+		} else {
+			*v1 = Vec2f(x, y);
+			code1 = OutCode(x, y, x_min, y_min, x_max, y_max);
 		}
 	}
+
+	return true;
 }
 
-static void DrawTriangle(Backbuffer *buffer, vec2 v0, vec2 v1, vec2 v2, vec3 colour)
+// bresenham, integer only; walks a pixel pointer so nothing is bounds
+// checked, both ends must already be inside the buffer
+void DrawLine(Backbuffer *buffer, s32 x0, s32 y0, s32 x1, s32 y1, u32 colour)
 {
-	DrawLine(buffer, v0, v1, colour);
-	DrawLine(buffer, v1, v2, colour);
-	DrawLine(buffer, v2, v0, colour);
+	s32 dx = abs(x1 - x0);
+	s32 dy = -abs(y1 - y0);
+	s32 step_x = x0 < x1 ? 1 : -1;
+	s32 step_y = y0 < y1 ? buffer->width : -buffer->width;
+	s32 error = dx + dy;
+
+	u32 *pixel = (u32 *)buffer->memory + ((s64)y0 * buffer->width + x0);
+	u32 *last = (u32 *)buffer->memory + ((s64)y1 * buffer->width + x1);
+	for (;;) {
+		*pixel = colour;
+		if (pixel == last)
+			break;
+
+		s32 twice_error = 2 * error;
+		if (twice_error >= dy) {
+			error += dy;
+			pixel += step_x;
+		}
+		if (twice_error <= dx) {
+			error += dx;
+			pixel += step_y;
+		}
+	}
 }
 
 static int InTriangle(vec2 a, vec2 b, vec2 c, vec2 p, f32 *sp, f32 *tp)
@@ -108,17 +155,55 @@ static void FillTriangle(Backbuffer *buffer, vec3 point0, vec3 point1, vec3 poin
 	}
 }
 
-static vec2 Vec2Interpolate(vec2 v[3], f32 s, f32 t) {
-	vec2 result;
-	result.x = ((1.0f - s - t) * v[0].x + s * v[1].x + t * v[2].x);
-	result.y = ((1.0f - s - t) * v[0].y + s * v[1].y + t * v[2].y);
-	return result;
+// a varying divided by w, and 1/w itself, are affine in screen space; the
+// planes are set up once per triangle as values at the first vertex plus
+// steps along the s and t barycentrics
+typedef struct VaryingPlanes {
+	f32 base[MAX_VARYINGS];
+	f32 ds[MAX_VARYINGS];
+	f32 dt[MAX_VARYINGS];
+	f32 w_base, w_ds, w_dt;
+	s32 num_varyings;
+} VaryingPlanes;
+
+static void SetupVaryingPlanes(VaryingPlanes *planes, Varyings *varyings, s32 num_varyings, f32 inverse_w[3])
+{
+	planes->num_varyings = (num_varyings + 3) & ~3;
+	planes->w_base = inverse_w[0];
+	planes->w_ds = inverse_w[1] - inverse_w[0];
+	planes->w_dt = inverse_w[2] - inverse_w[0];
+
+	// lanes past num_varyings are never written by the vertex shader, left
+	// as they are they can hold denormals that stall every fragment
+	for (s32 k = num_varyings; k < planes->num_varyings; k++) {
+		planes->base[k] = 0.0f;
+		planes->ds[k] = 0.0f;
+		planes->dt[k] = 0.0f;
+	}
+
+	for (s32 k = 0; k < num_varyings; k++) {
+		f32 a0 = varyings->out_varyings[0][k] * inverse_w[0];
+		f32 a1 = varyings->out_varyings[1][k] * inverse_w[1];
+		f32 a2 = varyings->out_varyings[2][k] * inverse_w[2];
+		planes->base[k] = a0;
+		planes->ds[k] = a1 - a0;
+		planes->dt[k] = a2 - a0;
+	}
 }
 
-static void InterpolateVaryings(f32 s, f32 t, void *varyings_) {
-	Varyings *varyings = (Varyings *)varyings_;
-	vec2 *out_texcoords = varyings->out_texcoords;
-	varyings->in_texcoord = Vec2Interpolate(out_texcoords, s, t);
+static void InterpolateVaryings(VaryingPlanes *planes, f32 s, f32 t, f32 *in_varyings)
+{
+	f32 w = 1.0f / (planes->w_base + s * planes->w_ds + t * planes->w_dt);
+	__m128 ws = _mm_set1_ps(w);
+	__m128 ss = _mm_set1_ps(s * w);
+	__m128 ts = _mm_set1_ps(t * w);
+
+	for (s32 k = 0; k < planes->num_varyings; k += 4) {
+		__m128 value = _mm_mul_ps(_mm_loadu_ps(&planes->base[k]), ws);
+		value = _mm_add_ps(value, _mm_mul_ps(_mm_loadu_ps(&planes->ds[k]), ss));
+		value = _mm_add_ps(value, _mm_mul_ps(_mm_loadu_ps(&planes->dt[k]), ts));
+		_mm_storeu_ps(&in_varyings[k], value);
+	}
 }
 
 void Draw(Backbuffer *buffer, Program *program, mat4 viewport)
@@ -126,15 +211,20 @@ void Draw(Backbuffer *buffer, Program *program, mat4 viewport)
 	void *varyings = program->varyings;
 	void *uniforms = program->uniforms;
 	vec3 screen_coords[3];
+	f32 inverse_w[3];
 
 	for (s32 i = 0; i < 3; i++) {
 		vec4 clip_coord = VertexShader(i, varyings, uniforms);
+		inverse_w[i] = 1.0f / clip_coord.w;
 		vec4 coord = Vec4f(clip_coord.x / clip_coord.w, clip_coord.y / clip_coord.w, clip_coord.z / clip_coord.w, clip_coord.w / clip_coord.w);
 		vec4 ndc_coord = Mat4MultiplyVec4(viewport, coord);
 		screen_coords[i].x = ndc_coord.x;
 		screen_coords[i].y = ndc_coord.y;
 		screen_coords[i].z = ndc_coord.z;
 	}
+	VaryingPlanes planes;
+	SetupVaryingPlanes(&planes, (Varyings *)varyings, program->num_varyings, inverse_w);
+
 	s32 min_x = buffer->width - 1, min_y = buffer->height - 1;
 	s32 max_x = 0, max_y = 0;
 
@@ -143,10 +233,10 @@ void Draw(Backbuffer *buffer, Program *program, mat4 viewport)
 	max_x = max(screen_coords[2].x, max(screen_coords[1].x, max(screen_coords[0].x, max_x)));
 	max_y = max(screen_coords[2].y, max(screen_coords[1].y, max(screen_coords[0].y, max_y)));
 
-	min_x = max(0, min_x);
-	min_y = max(0, min_y);
-	max_x = min(buffer->width - 1, max_x);
-	max_y = min(buffer->height - 1, max_y);
+	min_x = max(buffer->clip_x0, min_x);
+	min_y = max(buffer->clip_y0, min_y);
+	max_x = min(buffer->clip_x1, min(buffer->width - 1, max_x));
+	max_y = min(buffer->clip_y1, min(buffer->height - 1, max_y));
 
 	for (s32 j = min_y; j < max_y; j++) {
 		for (s32 i = min_x; i < max_x; i++) {
@@ -157,8 +247,10 @@ void Draw(Backbuffer *buffer, Program *program, mat4 viewport)
 			f32 s, t;
 			if (InTriangle(point0, point1, point2, point, &s, &t)) {
 				f32 depth = (1.0f - s - t) * screen_coords[0].z + s * screen_coords[1].z + t * screen_coords[2].z;
-				if (buffer->zbuffer[j * buffer->width + i] < depth) {
-					InterpolateVaryings(s, t, varyings);
+				f32 stored = buffer->zbuffer[j * buffer->width + i];
+				if (buffer->depth_test == DEPTH_TEST_EQUAL ? stored == depth : stored < depth) {
+					InterpolateVaryings(&planes, s, t, ((Varyings *)varyings)->in_varyings);
+					((Varyings *)varyings)->in_depth = depth;
 					vec3 colour = FragmentShader(varyings, uniforms);
 					DrawPixel(buffer, point.x, point.y, colour);
 					buffer->zbuffer[j * buffer->width + i] = depth;
@@ -166,4 +258,208 @@ void Draw(Backbuffer *buffer, Program *program, mat4 viewport)
 			}
 		}
 	}
-}
\ No newline at end of file
+}
+
+DepthTarget BackbufferDepth(Backbuffer *buffer)
+{
+	DepthTarget target;
+	target.depth = buffer->zbuffer;
+	target.width = buffer->width;
+	target.height = buffer->height;
+	target.clip_x0 = buffer->clip_x0;
+	target.clip_y0 = buffer->clip_y0;
+	target.clip_x1 = buffer->clip_x1;
+	target.clip_y1 = buffer->clip_y1;
+	return target;
+}
+
+// Draw's setup and coverage, evaluated 4 pixels at a time with the same
+// float operations in the same order so depths match bit for bit
+void DrawDepth(DepthTarget *target, vec3 positions[3], mat4 mvp, mat4 viewport)
+{
+	vec3 screen_coords[3];
+
+	for (s32 i = 0; i < 3; i++) {
+		vec4 clip_coord = Mat4MultiplyVec4(mvp, Vec4(positions[i], 1.0f));
+		vec4 coord = Vec4f(clip_coord.x / clip_coord.w, clip_coord.y / clip_coord.w, clip_coord.z / clip_coord.w, clip_coord.w / clip_coord.w);
+		vec4 ndc_coord = Mat4MultiplyVec4(viewport, coord);
+		screen_coords[i].x = ndc_coord.x;
+		screen_coords[i].y = ndc_coord.y;
+		screen_coords[i].z = ndc_coord.z;
+	}
+
+	vec2 point0 = Vec2i(screen_coords[0].x, screen_coords[0].y);
+	vec2 point1 = Vec2i(screen_coords[1].x, screen_coords[1].y);
+	vec2 point2 = Vec2i(screen_coords[2].x, screen_coords[2].y);
+	vec2 AB = Vec2Minus(point1, point0);
+	vec2 AC = Vec2Minus(point2, point0);
+	s32 denom = AB.x * AC.y - AB.y * AC.x;
+	if (denom == 0)
+		return;
+
+	s32 min_x = target->width - 1, min_y = target->height - 1;
+	s32 max_x = 0, max_y = 0;
+
+	min_x = min(screen_coords[2].x, min(screen_coords[1].x, min(screen_coords[0].x, min_x)));
+	min_y = min(screen_coords[2].y, min(screen_coords[1].y, min(screen_coords[0].y, min_y)));
+	max_x = max(screen_coords[2].x, max(screen_coords[1].x, max(screen_coords[0].x, max_x)));
+	max_y = max(screen_coords[2].y, max(screen_coords[1].y, max(screen_coords[0].y, max_y)));
+
+	min_x = max(target->clip_x0, min_x);
+	min_y = max(target->clip_y0, min_y);
+	max_x = min(target->clip_x1, min(target->width - 1, max_x));
+	max_y = min(target->clip_y1, min(target->height - 1, max_y));
+
+	__m128 ab_x = _mm_set1_ps(AB.x), ab_y = _mm_set1_ps(AB.y);
+	__m128 ac_x = _mm_set1_ps(AC.x), ac_y = _mm_set1_ps(AC.y);
+	__m128 denoms = _mm_set1_ps((f32)denom);
+	__m128 z0 = _mm_set1_ps(screen_coords[0].z);
+	__m128 z1 = _mm_set1_ps(screen_coords[1].z);
+	__m128 z2 = _mm_set1_ps(screen_coords[2].z);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+
+	for (s32 j = min_y; j < max_y; j++) {
+		__m128 ap_y = _mm_set1_ps((f32)j - point0.y);
+		f32 *row = &target->depth[j * target->width];
+		s32 i = min_x;
+
+		for (; i + 4 <= max_x; i += 4) {
+			__m128 ap_x = _mm_add_ps(_mm_set1_ps((f32)i - point0.x), lanes);
+			__m128 s = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(ac_y, ap_x), _mm_mul_ps(ac_x, ap_y)), denoms);
+			__m128 t = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(ab_x, ap_y), _mm_mul_ps(ab_y, ap_x)), denoms);
+
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(s, zero), _mm_cmpge_ps(t, zero));
+			inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_add_ps(s, t), one));
+			if (!_mm_movemask_ps(inside))
+				continue;
+
+			__m128 depth = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, s), t), z0);
+			depth = _mm_add_ps(depth, _mm_mul_ps(s, z1));
+			depth = _mm_add_ps(depth, _mm_mul_ps(t, z2));
+
+			__m128 stored = _mm_loadu_ps(&row[i]);
+			__m128 write = _mm_and_ps(inside, _mm_cmplt_ps(stored, depth));
+			_mm_storeu_ps(&row[i], _mm_or_ps(_mm_and_ps(write, depth), _mm_andnot_ps(write, stored)));
+		}
+
+		for (; i < max_x; i++) {
+			f32 s, t;
+			if (InTriangle(point0, point1, point2, Vec2i(i, j), &s, &t)) {
+				f32 depth = (1.0f - s - t) * screen_coords[0].z + s * screen_coords[1].z + t * screen_coords[2].z;
+				if (row[i] < depth)
+					row[i] = depth;
+			}
+		}
+	}
+}
+
+// rotated grid, offsets from the pixel corner
+static const f32 sample_offsets[MSAA_SAMPLES][2] = {
+	{ 0.375f, 0.125f }, { 0.875f, 0.375f }, { 0.125f, 0.625f }, { 0.625f, 0.875f },
+};
+
+static u32 PackColour(vec3 colour)
+{
+	return ((u32)colour.r << 16) | ((u32)colour.g << 8) | (u32)colour.b;
+}
+
+void DrawMultisample(MultisampleBuffer *buffer, Program *program, mat4 viewport)
+{
+	void *varyings = program->varyings;
+	void *uniforms = program->uniforms;
+	vec3 screen_coords[3];
+	f32 inverse_w[3];
+
+	for (s32 i = 0; i < 3; i++) {
+		vec4 clip_coord = VertexShader(i, varyings, uniforms);
+		inverse_w[i] = 1.0f / clip_coord.w;
+		vec4 coord = Vec4f(clip_coord.x / clip_coord.w, clip_coord.y / clip_coord.w, clip_coord.z / clip_coord.w, 1.0f);
+		vec4 ndc_coord = Mat4MultiplyVec4(viewport, coord);
+		screen_coords[i] = Vec3f(ndc_coord.x, ndc_coord.y, ndc_coord.z);
+	}
+
+	// edge k is opposite vertex k, e(x, y) = a x + b y + c; dividing by the
+	// area makes them barycentrics for either winding
+	f32 x0 = screen_coords[0].x, y0 = screen_coords[0].y;
+	f32 x1 = screen_coords[1].x, y1 = screen_coords[1].y;
+	f32 x2 = screen_coords[2].x, y2 = screen_coords[2].y;
+	f32 area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+	if (area == 0.0f)
+		return;
+	f32 inverse_area = 1.0f / area;
+	f32 edge_a[3] = { (y1 - y2) * inverse_area, (y2 - y0) * inverse_area, (y0 - y1) * inverse_area };
+	f32 edge_b[3] = { (x2 - x1) * inverse_area, (x0 - x2) * inverse_area, (x1 - x0) * inverse_area };
+	f32 edge_c[3] = {
+		(x1 * y2 - x2 * y1) * inverse_area,
+		(x2 * y0 - x0 * y2) * inverse_area,
+		(x0 * y1 - x1 * y0) * inverse_area,
+	};
+
+	VaryingPlanes planes;
+	SetupVaryingPlanes(&planes, (Varyings *)varyings, program->num_varyings, inverse_w);
+
+	s32 min_x = max(0, (s32)floorf(min(x0, min(x1, x2))));
+	s32 min_y = max(0, (s32)floorf(min(y0, min(y1, y2))));
+	s32 max_x = min(buffer->width - 1, (s32)ceilf(max(x0, max(x1, x2))));
+	s32 max_y = min(buffer->height - 1, (s32)ceilf(max(y0, max(y1, y2))));
+
+	for (s32 j = min_y; j <= max_y; j++) {
+		for (s32 i = min_x; i <= max_x; i++) {
+			s64 pixel = (s64)j * buffer->width + i;
+			f32 *depths = &buffer->depth[pixel * MSAA_SAMPLES];
+			f32 sum_s = 0.0f, sum_t = 0.0f, sum_depth = 0.0f;
+			u32 mask = 0;
+			s32 count = 0;
+
+			for (s32 k = 0; k < MSAA_SAMPLES; k++) {
+				f32 px = i + sample_offsets[k][0];
+				f32 py = j + sample_offsets[k][1];
+				f32 b0 = edge_a[0] * px + edge_b[0] * py + edge_c[0];
+				f32 b1 = edge_a[1] * px + edge_b[1] * py + edge_c[1];
+				f32 b2 = edge_a[2] * px + edge_b[2] * py + edge_c[2];
+				if (b0 < 0.0f || b1 < 0.0f || b2 < 0.0f)
+					continue;
+
+				f32 depth = b0 * screen_coords[0].z + b1 * screen_coords[1].z + b2 * screen_coords[2].z;
+				if (depths[k] < depth) {
+					depths[k] = depth;
+					mask |= 1 << k;
+					sum_s += b1;
+					sum_t += b2;
+					sum_depth += depth;
+					count++;
+				}
+			}
+			if (!mask)
+				continue;
+
+			// shaded at the centroid of the samples that passed, so the
+			// varyings are never extrapolated past the triangle
+			InterpolateVaryings(&planes, sum_s / count, sum_t / count, ((Varyings *)varyings)->in_varyings);
+			((Varyings *)varyings)->in_depth = sum_depth / count;
+			u32 colour = PackColour(FragmentShader(varyings, uniforms));
+			u32 *samples = &buffer->sample_colour[pixel * (MSAA_SAMPLES - 1)];
+
+			if (mask == (1 << MSAA_SAMPLES) - 1) {
+				buffer->colour[pixel] = colour;
+				buffer->split[pixel] = 0;
+				continue;
+			}
+
+			if (!buffer->split[pixel]) {
+				for (s32 k = 0; k < MSAA_SAMPLES - 1; k++)
+					samples[k] = buffer->colour[pixel];
+				buffer->split[pixel] = 1;
+				buffer->num_splits++;
+			}
+			if (mask & 1)
+				buffer->colour[pixel] = colour;
+			for (s32 k = 1; k < MSAA_SAMPLES; k++) {
+				if (mask & (1 << k))
+					samples[k - 1] = colour;
+			}
+		}
+	}
+}
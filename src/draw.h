@@ -1,9 +1,32 @@
 #ifndef DRAW_H
 #define DRAW_H
 
+#include <xmmintrin.h>
+
 #include "platform.h"
 #include "shaders.h"
+#include "msaa.h"
+
+// a depth buffer and the rectangle DrawDepth may write, larger is nearer
+typedef struct DepthTarget {
+	f32 *depth;
+	s32 width, height;
+	s32 clip_x0, clip_y0;
+	s32 clip_x1, clip_y1;
+} DepthTarget;
+
+DepthTarget BackbufferDepth(Backbuffer *buffer);
 
 void Draw(Backbuffer *buffer, Program *program, mat4 viewport);
 
+// trims v0-v1 to the buffer's clip rect, false if nothing is left
+b32 ClipLine(Backbuffer *buffer, vec2 *v0, vec2 *v1);
+// ends inclusive and inside the buffer, colour as 0xRRGGBB
+void DrawLine(Backbuffer *buffer, s32 x0, s32 y0, s32 x1, s32 y1, u32 colour);
+// positions only, no varyings or shading; covers and writes exactly the
+// depths Draw would, so it doubles as a z prepass
+void DrawDepth(DepthTarget *target, vec3 positions[3], mat4 mvp, mat4 viewport);
+// depth tested per sample, shaded once per pixel
+void DrawMultisample(MultisampleBuffer *buffer, Program *program, mat4 viewport);
+
 #endif
\ No newline at end of file
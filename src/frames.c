@@ -0,0 +1,108 @@
+#include "frames.h"
+
+static DWORD WINAPI PresentThread(LPVOID data)
+{
+	FrameRing *ring = (FrameRing *)data;
+
+	EnterCriticalSection(&ring->lock);
+	while (1) {
+		while (ring->running && ring->presented == ring->submitted)
+			SleepConditionVariableCS(&ring->frame_submitted, &ring->lock, INFINITE);
+		// only exit once everything submitted has gone out
+		if (ring->presented == ring->submitted)
+			break;
+
+		s64 frame = ring->presented;
+		Backbuffer *buffer = &ring->buffers[frame % ring->num_buffers];
+
+		LeaveCriticalSection(&ring->lock);
+		ring->present(buffer, frame, ring->user_data);
+		EnterCriticalSection(&ring->lock);
+
+		ring->presented++;
+		WakeAllConditionVariable(&ring->frame_presented);
+	}
+	LeaveCriticalSection(&ring->lock);
+
+	return 0;
+}
+
+void CreateFrameRing(FrameRing *ring, s32 num_buffers, s32 width, s32 height, PresentFunc present, void *user_data)
+{
+	memset(ring, 0, sizeof(FrameRing));
+
+	ring->num_buffers = max(2, min(MAX_FRAMES_IN_FLIGHT, num_buffers));
+	for (s32 i = 0; i < ring->num_buffers; i++)
+		CreateBackbuffer(&ring->buffers[i], width, height);
+
+	ring->present = present;
+	ring->user_data = user_data;
+
+	InitializeCriticalSection(&ring->lock);
+	InitializeConditionVariable(&ring->frame_submitted);
+	InitializeConditionVariable(&ring->frame_presented);
+
+	ring->running = true;
+	ring->thread = CreateThread(NULL, 0, PresentThread, ring, 0, NULL);
+}
+
+void DestroyFrameRing(FrameRing *ring)
+{
+	EnterCriticalSection(&ring->lock);
+	ring->running = false;
+	WakeAllConditionVariable(&ring->frame_submitted);
+	LeaveCriticalSection(&ring->lock);
+
+	WaitForSingleObject(ring->thread, INFINITE);
+	CloseHandle(ring->thread);
+
+	for (s32 i = 0; i < ring->num_buffers; i++)
+		FreeBackbuffer(&ring->buffers[i]);
+	DeleteCriticalSection(&ring->lock);
+	ring->num_buffers = 0;
+}
+
+void ResizeFrameRing(FrameRing *ring, s32 width, s32 height)
+{
+	FlushFrameRing(ring);
+	for (s32 i = 0; i < ring->num_buffers; i++) {
+		FreeBackbuffer(&ring->buffers[i]);
+		CreateBackbuffer(&ring->buffers[i], width, height);
+	}
+}
+
+// blocks while every slot is still waiting to be presented (back-pressure)
+Backbuffer *AcquireFrame(FrameRing *ring)
+{
+	assert(ring->acquired == ring->submitted);
+
+	EnterCriticalSection(&ring->lock);
+	while (ring->acquired - ring->presented >= ring->num_buffers)
+		SleepConditionVariableCS(&ring->frame_presented, &ring->lock, INFINITE);
+	Backbuffer *buffer = &ring->buffers[ring->acquired % ring->num_buffers];
+	ring->acquired++;
+	LeaveCriticalSection(&ring->lock);
+
+	return buffer;
+}
+
+void SubmitFrame(FrameRing *ring)
+{
+	EnterCriticalSection(&ring->lock);
+	ring->submitted = ring->acquired;
+	WakeConditionVariable(&ring->frame_submitted);
+	LeaveCriticalSection(&ring->lock);
+}
+
+void WaitForFrame(FrameRing *ring, s64 frame)
+{
+	EnterCriticalSection(&ring->lock);
+	while (ring->presented <= frame)
+		SleepConditionVariableCS(&ring->frame_presented, &ring->lock, INFINITE);
+	LeaveCriticalSection(&ring->lock);
+}
+
+void FlushFrameRing(FrameRing *ring)
+{
+	WaitForFrame(ring, ring->submitted - 1);
+}
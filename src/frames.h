@@ -0,0 +1,47 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <windows.h>
+#include <assert.h>
+#include <string.h>
+
+#include "types.h"
+#include "backbuffer.h"
+
+#define MAX_FRAMES_IN_FLIGHT 4
+
+// called on the present thread once a frame has been rendered; the buffer
+// is not handed back to the renderer until this returns
+typedef void (*PresentFunc)(Backbuffer *buffer, s64 frame, void *user_data);
+
+// ring of backbuffer/zbuffer pairs: the caller renders frame N+1 while
+// the present thread shows or encodes frame N. the fences are frame counters,
+// a slot is reusable once its previous frame has been presented
+typedef struct FrameRing {
+	Backbuffer buffers[MAX_FRAMES_IN_FLIGHT];
+	s32 num_buffers;
+
+	s64 acquired;
+	s64 submitted;
+	s64 presented;
+
+	PresentFunc present;
+	void *user_data;
+
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE frame_submitted;
+	CONDITION_VARIABLE frame_presented;
+	HANDLE thread;
+	b32 running;
+} FrameRing;
+
+void CreateFrameRing(FrameRing *ring, s32 num_buffers, s32 width, s32 height, PresentFunc present, void *user_data);
+void DestroyFrameRing(FrameRing *ring);
+void ResizeFrameRing(FrameRing *ring, s32 width, s32 height);
+
+Backbuffer *AcquireFrame(FrameRing *ring);
+void SubmitFrame(FrameRing *ring);
+void WaitForFrame(FrameRing *ring, s64 frame);
+void FlushFrameRing(FrameRing *ring);
+
+#endif
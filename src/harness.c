@@ -0,0 +1,552 @@
+#include "harness.h"
+
+#pragma warning(disable : 4996)
+
+static void RenderInstancedIdentity(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	Varyings varyings;
+	Uniforms uniforms;
+	Program program;
+	program.varyings = &varyings;
+	program.uniforms = &uniforms;
+
+	SetupUniforms(&uniforms, scene, camera);
+	program.num_varyings = NumVaryings(&uniforms);
+
+	mat4 instance = Mat4(1.0f);
+	ClearBackbuffer(buffer);
+	DrawInstanced(buffer, &program, Viewport(0, 0, buffer->width, buffer->height), scene->model, &instance, 1);
+}
+
+#define LOD_PIXEL_ERROR 1.0f
+#define LOD_INSTANCES 4
+
+// a row of copies shrinking on screen is drawn at full detail and through
+// SelectLOD; the far copies must drop triangles while the image only moves
+// along their silhouettes. the depth range only spans about one model
+// radius, so distance is stood in for by scale
+static void RenderLOD(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	static ModelLODs lods;
+	if (!lods.num_levels)
+		GenerateLODs(&lods, scene->model, MAX_LODS, NULL);
+
+	Varyings varyings;
+	Uniforms uniforms;
+	Program program;
+	program.varyings = &varyings;
+	program.uniforms = &uniforms;
+
+	f32 scales[LOD_INSTANCES] = { 0.5f, 1.0f / 8.0f, 1.0f / 64.0f, 1.0f / 256.0f };
+	f32 offsets[LOD_INSTANCES] = { -0.5f, 0.2f, 0.5f, 0.7f };
+	mat4 instances[LOD_INSTANCES];
+	for (s32 i = 0; i < LOD_INSTANCES; i++)
+		instances[i] = Mat4Multiply(Scale(scales[i]), Translate(Vec3f(offsets[i], 0.0f, 0.0f)));
+
+	Camera row_camera = MakeCamera(Vec3f(0.0f, 0.0f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+	SetupUniforms(&uniforms, scene, &row_camera);
+	program.num_varyings = NumVaryings(&uniforms);
+	mat4 viewport = Viewport(0, 0, buffer->width, buffer->height);
+
+	// pixels are only allowed to change in a band of LOD_PIXEL_ERROR either
+	// side of the silhouettes of copies drawn below level 0
+	b32 passed = true;
+	f32 allowed = 0.0f;
+	s32 previous_faces = scene->model->num_faces;
+	for (s32 i = 0; i < LOD_INSTANCES; i++) {
+		mat4 mvp = Mat4Multiply(instances[i], uniforms.mvp);
+		f32 radius = ProjectedRadius(mvp, scene->model->centre, scene->model->radius, buffer->width);
+		s32 level = SelectLOD(&lods, radius, LOD_PIXEL_ERROR);
+		if (level > 0)
+			allowed += 4.0f * 3.14159265f * (radius + LOD_PIXEL_ERROR) * LOD_PIXEL_ERROR;
+		if (lods.levels[level]->num_faces > previous_faces)
+			passed = false;
+		previous_faces = lods.levels[level]->num_faces;
+	}
+	if (!passed)
+		printf("lod: a farther copy draws more faces than a nearer one\n");
+	if (previous_faces == scene->model->num_faces) {
+		printf("lod: the farthest copy still draws all %d faces\n", previous_faces);
+		passed = false;
+	}
+
+	Backbuffer full = { 0 };
+	CreateBackbuffer(&full, buffer->width, buffer->height);
+	ClearBackbuffer(&full);
+	ClearBackbuffer(buffer);
+	DrawInstancedLOD(&full, &program, viewport, &lods, instances, LOD_INSTANCES, 0.0f);
+	DrawInstancedLOD(buffer, &program, viewport, &lods, instances, LOD_INSTANCES, LOD_PIXEL_ERROR);
+	CompareStats stats = CompareBackbuffers(&full, buffer, 24);
+	if (stats.over_threshold > allowed) {
+		printf("lod: %d pixels moved, at most %.0f expected\n", stats.over_threshold, allowed);
+		passed = false;
+	}
+	FreeBackbuffer(&full);
+
+	// the copy under test is large enough on screen to keep level 0
+	mat4 instance = Mat4(1.0f);
+	SetupUniforms(&uniforms, scene, camera);
+	ClearBackbuffer(buffer);
+	DrawInstancedLOD(buffer, &program, viewport, &lods, &instance, 1, LOD_PIXEL_ERROR);
+	if (!passed)
+		ClearBackbuffer(buffer);
+}
+
+static void RenderBaked(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	static LightingCache cache;
+	static b32 created;
+	if (!created) {
+		CreateLightingCache(&cache);
+		created = true;
+	}
+
+	LightingCache *previous = scene->lighting_cache;
+	scene->lighting_cache = &cache;
+	RenderScene(buffer, scene, camera);
+	scene->lighting_cache = previous;
+}
+
+static void RenderCompressed(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	static Image *maps[3];
+	Image *sources[3] = { scene->diffuse_map, scene->normal_map, scene->specular_map };
+	for (s32 i = 0; i < 3 && !maps[i]; i++)
+		maps[i] = CompressImage(sources[i], sources[i]->channels == 4 ? TEXTURE_BC3 : TEXTURE_BC1, NULL);
+
+	Scene compressed = *scene;
+	compressed.diffuse_map = maps[0];
+	compressed.normal_map = maps[1];
+	compressed.specular_map = maps[2];
+	RenderScene(buffer, &compressed, camera);
+}
+
+static void RenderTypedMaps(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	static Image *normal_map, *specular_map;
+	if (!normal_map) {
+		normal_map = ConvertImage(scene->normal_map, TEXTURE_FORMAT_SNORM8X4, NULL);
+		specular_map = ConvertImage(scene->specular_map, TEXTURE_FORMAT_R8, NULL);
+	}
+
+	Scene typed = *scene;
+	typed.normal_map = normal_map;
+	typed.specular_map = specular_map;
+	RenderScene(buffer, &typed, camera);
+}
+
+// moller-trumbore, distance along direction or -1 for a miss
+static f32 IntersectRay(vec3 origin, vec3 direction, vec3 p0, vec3 p1, vec3 p2)
+{
+	vec3 edge1 = Vec3Minus(p1, p0);
+	vec3 edge2 = Vec3Minus(p2, p0);
+	vec3 p = Vec3Cross(direction, edge2);
+	f32 det = Vec3Dot(edge1, p);
+	if (fabsf(det) < 1e-12f)
+		return -1.0f;
+
+	vec3 s = Vec3Minus(origin, p0);
+	f32 u = Vec3Dot(s, p) / det;
+	if (u < 0.0f || u > 1.0f)
+		return -1.0f;
+	vec3 q = Vec3Cross(s, edge1);
+	f32 v = Vec3Dot(direction, q) / det;
+	if (v < 0.0f || u + v > 1.0f)
+		return -1.0f;
+	return Vec3Dot(edge2, q) / det;
+}
+
+// the scene shadowed, checked against rays cast to the light from the
+// centre of every face the camera sees: faces something else hides from
+// the light must come out darker than without shadows, and faces in the
+// open unchanged. most of both have to agree, a shadow map texel straddles
+// every edge and ray
+static void RenderShadows(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	static ShadowMap shadow_map;
+	if (!shadow_map.depth)
+		CreateShadowMap(&shadow_map, SHADOW_MAP_SIZE);
+
+	Backbuffer lit = { 0 };
+	CreateBackbuffer(&lit, buffer->width, buffer->height);
+	RenderScene(&lit, scene, camera);
+
+	Scene shadowed = *scene;
+	shadowed.shadow_map = &shadow_map;
+	shadowed.quality = SHADING_FULL;
+	RenderScene(buffer, &shadowed, camera);
+
+	Model *model = scene->model;
+	vec3 light = Vec3Normalise(scene->light);
+	mat4 transform = Mat4Multiply(ViewProjection(camera), Viewport(0, 0, buffer->width, buffer->height));
+	u32 *shadowed_pixels = (u32 *)buffer->memory;
+	u32 *lit_pixels = (u32 *)lit.memory;
+	s32 num_hidden = 0, num_darkened = 0, num_open = 0, num_unchanged = 0;
+
+	for (s32 i = 0; i < model->num_faces; i++) {
+		vec3 *p = &model->positions[i * 3];
+		vec3 normal = Vec3Normalise(Vec3Cross(Vec3Minus(p[1], p[0]), Vec3Minus(p[2], p[0])));
+		if (Vec3Dot(normal, light) < 0.2f)
+			continue;
+
+		vec3 centre = Vec3Scale(Vec3Add(Vec3Add(p[0], p[1]), p[2]), 1.0f / 3.0f);
+		vec4 screen = Mat4MultiplyVec4(transform, Vec4(centre, 1.0f));
+		s32 x = (s32)(screen.x / screen.w);
+		s32 y = (s32)(screen.y / screen.w);
+		if (x < 0 || y < 0 || x >= buffer->width || y >= buffer->height)
+			continue;
+		s32 index = y * buffer->width + x;
+		if (fabsf(buffer->zbuffer[index] - screen.z / screen.w) > 1.0f)
+			continue;
+
+		b32 hidden = false;
+		for (s32 j = 0; j < model->num_faces && !hidden; j++) {
+			vec3 *q = &model->positions[j * 3];
+			hidden = j != i && IntersectRay(centre, light, q[0], q[1], q[2]) > 1e-3f;
+		}
+
+		u32 a = lit_pixels[index], b = shadowed_pixels[index];
+		s32 brightness_lit = (a & 0xFF) + (a >> 8 & 0xFF) + (a >> 16 & 0xFF);
+		s32 brightness_shadowed = (b & 0xFF) + (b >> 8 & 0xFF) + (b >> 16 & 0xFF);
+		if (hidden) {
+			num_hidden++;
+			num_darkened += brightness_shadowed < brightness_lit;
+		} else {
+			num_open++;
+			num_unchanged += a == b;
+		}
+	}
+	FreeBackbuffer(&lit);
+
+	if (num_hidden < 16 || num_darkened < num_hidden * 3 / 4 || num_unchanged < num_open * 19 / 20) {
+		printf("shadows: %d of %d hidden faces darkened, %d of %d open faces unchanged\n",
+			num_darkened, num_hidden, num_unchanged, num_open);
+		ClearBackbuffer(buffer);
+	}
+}
+
+#define BATCH_VIEWS 4
+
+static void KeepView(Backbuffer *buffer, s32 view, void *user_data)
+{
+	Backbuffer *views = (Backbuffer *)user_data;
+	CopyBackbuffer(&views[view], buffer);
+}
+
+// the view under test and three mirrored copies of it rendered across the
+// job system; the copies are checked against RenderScene here, and any of
+// them differing blanks the result so the mode fails
+static void RenderBatchViews(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	static JobSystem jobs;
+	static b32 created;
+	if (!created) {
+		CreateJobSystem(&jobs, 0, 0);
+		created = true;
+	}
+
+	vec3 eye = camera->eye;
+	Camera cameras[BATCH_VIEWS];
+	cameras[0] = *camera;
+	cameras[1] = MakeCamera(Vec3f(-eye.x, eye.y, eye.z), camera->centre, camera->up);
+	cameras[2] = MakeCamera(Vec3f(eye.x, eye.y, -eye.z), camera->centre, camera->up);
+	cameras[3] = MakeCamera(Vec3f(-eye.x, eye.y, -eye.z), camera->centre, camera->up);
+
+	Backbuffer views[BATCH_VIEWS];
+	for (s32 i = 0; i < BATCH_VIEWS; i++)
+		CreateBackbuffer(&views[i], buffer->width, buffer->height);
+
+	RenderBatch batch;
+	batch.scene = scene;
+	batch.cameras = cameras;
+	batch.num_views = BATCH_VIEWS;
+	batch.width = buffer->width;
+	batch.height = buffer->height;
+	batch.view_done = KeepView;
+	batch.user_data = views;
+	RenderViews(&jobs, &batch);
+
+	b32 matched = true;
+	for (s32 i = 1; i < BATCH_VIEWS; i++) {
+		RenderScene(buffer, scene, &cameras[i]);
+		CompareStats stats = CompareBackbuffers(buffer, &views[i], 0);
+		if (stats.max_error != 0) {
+			printf("batch view %d differs from RenderScene, max %d\n", i, stats.max_error);
+			matched = false;
+		}
+	}
+
+	CopyBackbuffer(buffer, &views[0]);
+	if (!matched)
+		ClearBackbuffer(buffer);
+	for (s32 i = 0; i < BATCH_VIEWS; i++)
+		FreeBackbuffer(&views[i]);
+}
+
+// maps tiled to page files and streamed back in, redrawn until no sample
+// had to fall back to a coarser level
+// the page files are tiled once and kept open across views; RunHarness
+// closes and deletes them when it is done
+static VirtualTexture virtual_textures[3];
+static char virtual_files[3][MAX_PATH + 32];
+static s32 num_virtual_textures;
+
+static void CloseVirtualMaps(void)
+{
+	for (s32 i = 0; i < num_virtual_textures; i++) {
+		CloseVirtualTexture(&virtual_textures[i]);
+		DeleteFileA(virtual_files[i]);
+	}
+	num_virtual_textures = 0;
+}
+
+static void RenderVirtual(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	if (!num_virtual_textures) {
+		Image *sources[3] = { scene->diffuse_map, scene->normal_map, scene->specular_map };
+		char directory[MAX_PATH];
+		GetTempPathA(sizeof(directory), directory);
+		for (s32 i = 0; i < 3; i++) {
+			snprintf(virtual_files[i], sizeof(virtual_files[i]), "%sharness_map%d.vtex", directory, i);
+			b32 ok = TileImage(sources[i], virtual_files[i]) && OpenVirtualTexture(&virtual_textures[i], virtual_files[i], NULL);
+			assert(ok);
+			num_virtual_textures++;
+		}
+	}
+
+	Scene streamed = *scene;
+	streamed.diffuse_map = &virtual_textures[0].image;
+	streamed.normal_map = &virtual_textures[1].image;
+	streamed.specular_map = &virtual_textures[2].image;
+
+	for (s32 pass = 0; pass < 8; pass++) {
+		UpdateSceneTextures(&streamed);
+		s64 fallbacks = virtual_textures[0].fallback_samples + virtual_textures[1].fallback_samples + virtual_textures[2].fallback_samples;
+		RenderScene(buffer, &streamed, camera);
+		if (virtual_textures[0].fallback_samples + virtual_textures[1].fallback_samples + virtual_textures[2].fallback_samples == fallbacks)
+			break;
+		for (s32 i = 0; i < 3; i++)
+			FlushVirtualTexture(&virtual_textures[i]);
+	}
+}
+
+// the cluster is started once and kept across views, RunHarness stops it
+static ClusterAssets *cluster_assets;
+static RenderCluster cluster;
+static b32 cluster_started;
+
+static void StopCluster(void)
+{
+	if (cluster_started)
+		StopRenderCluster(&cluster);
+	cluster_started = false;
+}
+
+// bands of rows rendered by worker processes, which load the scene's assets
+// the way it was loaded; a few frames so the bands have moved off the even
+// split. streamed maps page in at each process's own pace, so those scenes
+// are rendered here instead
+static void RenderClustered(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	if (cluster_assets->virtual_maps) {
+		RenderScene(buffer, scene, camera);
+		return;
+	}
+
+	if (!cluster_started)
+		cluster_started = StartRenderCluster(&cluster, 3, cluster_assets);
+
+	ClearBackbuffer(buffer);
+	for (s32 frame = 0; cluster_started && frame < 3; frame++) {
+		if (!RenderClusterFrame(&cluster, buffer, scene, camera))
+			break;
+	}
+}
+
+// draws the model next to a small second copy, then drops the copy so the
+// tiles it covered are redrawn on their own
+static void RenderIncrementalRemoval(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	static IncrementalRenderer renderer;
+	static b32 created;
+	if (!created) {
+		CreateIncrementalRenderer(&renderer, buffer->width, buffer->height);
+		created = true;
+	}
+
+	SceneObject objects[2];
+	objects[0].model = scene->model;
+	objects[0].transform = Mat4(1.0f);
+	objects[0].version = 0;
+	objects[1].model = scene->model;
+	objects[1].transform = Mat4Multiply(Scale(0.3f), Translate(Vec3f(0.6f, 0.4f, 0.2f)));
+	objects[1].version = 0;
+
+	RenderIncremental(&renderer, scene, camera, objects, 2, buffer->width, buffer->height);
+	RenderIncremental(&renderer, scene, camera, objects, 1, buffer->width, buffer->height);
+	CopyBackbuffer(buffer, &renderer.canvas);
+}
+
+// every optimised path gets an entry here and is checked against the
+// plain Draw/FragmentShader output; "reference" rerun catches nondeterminism
+static RenderMode render_modes[] = {
+	{ "reference", RenderScene, 0, 0.0f, 0.0f },
+	{ "instanced", RenderInstancedIdentity, 0, 0.0f, 0.0f },
+	{ "lod", RenderLOD, 0, 0.0f, 0.0f },
+	// draw order only changes which of two equal depths wins
+	{ "sorted", RenderSceneSorted, 0, 1.0f, 0.001f },
+	{ "baked", RenderBaked, 0, 0.0f, 0.0f },
+	// what the light can't reach darkens, checked against rays in the mode
+	{ "shadows", RenderShadows, 0, 10.0f, 0.15f },
+	{ "batch", RenderBatchViews, 0, 0.0f, 0.0f },
+	{ "incremental", RenderIncrementalRemoval, 0, 0.0f, 0.0f },
+	// equal depths shade the last triangle drawn instead of the first
+	{ "prepass", RenderScenePrepass, 0, 1.0f, 0.001f },
+	// samples at subpixel positions, so edges and fine texture move a little
+	{ "msaa", RenderSceneMultisample, 24, 4.0f, 0.01f },
+	// lossy 5:6:5 endpoints, only block edges and high contrast detail move
+	{ "compressed", RenderCompressed, 24, 4.0f, 0.01f },
+	// normals are renormalised and rounded to 8 bit signed
+	{ "typed", RenderTypedMaps, 8, 1.0f, 0.001f },
+	// level 0 pages hold the source texels unchanged
+	{ "virtual", RenderVirtual, 0, 0.0f, 0.0f },
+	// every face is drawn in the same order, only clipped to its band
+	{ "cluster", RenderClustered, 0, 0.0f, 0.0f },
+	// the cheaper tiers through paths other than RenderScene's, the depth
+	// tier through FragmentShader rather than the depth kernel
+	{ "gouraud", RenderInstancedIdentity, 0, 0.0f, 0.0f, SHADING_GOURAUD },
+	// sorted, so two equal depths can swap faces whose flat shades differ a lot
+	{ "flat", RenderSceneSorted, 0, 2.0f, 0.002f, SHADING_FLAT },
+	{ "depth", RenderInstancedIdentity, 0, 0.0f, 0.0f, SHADING_DEPTH },
+};
+
+CompareStats CompareBackbuffers(Backbuffer *reference, Backbuffer *test, s32 threshold)
+{
+	CompareStats stats = { 0 };
+	u32 *expected = (u32 *)reference->memory;
+	u32 *actual = (u32 *)test->memory;
+	f64 sum = 0.0;
+
+	assert(reference->width == test->width && reference->height == test->height);
+
+	stats.num_pixels = reference->width * reference->height;
+	for (s32 i = 0; i < stats.num_pixels; i++) {
+		s32 pixel_error = 0;
+		for (s32 shift = 0; shift < 24; shift += 8) {
+			s32 a = (expected[i] >> shift) & 0xFF;
+			s32 b = (actual[i] >> shift) & 0xFF;
+			s32 error = abs(a - b);
+			sum += (f64)error * error;
+			pixel_error = max(pixel_error, error);
+		}
+		stats.max_error = max(stats.max_error, pixel_error);
+		if (pixel_error > threshold)
+			stats.over_threshold++;
+	}
+	stats.rmse = sqrt(sum / ((f64)stats.num_pixels * 3.0));
+
+	return stats;
+}
+
+static b32 WritePixels(const char *file_name, s32 width, s32 height, u8 *pixels)
+{
+	Image image;
+	image.width = width;
+	image.height = height;
+	image.channels = 3;
+	image.buffer = pixels;
+	return WriteToTGA(file_name, &image);
+}
+
+// absolute difference per channel, amplified so small errors are visible
+b32 WriteDiffTGA(const char *file_name, Backbuffer *reference, Backbuffer *test)
+{
+	s32 num_pixels = reference->width * reference->height;
+	u32 *expected = (u32 *)reference->memory;
+	u32 *actual = (u32 *)test->memory;
+	u8 *pixels = (u8 *)malloc((size_t)num_pixels * 3);
+
+	for (s32 i = 0; i < num_pixels; i++) {
+		for (s32 c = 0; c < 3; c++) {
+			s32 a = (expected[i] >> (c * 8)) & 0xFF;
+			s32 b = (actual[i] >> (c * 8)) & 0xFF;
+			pixels[i * 3 + c] = (u8)min(255, abs(a - b) * 8);
+		}
+	}
+
+	b32 written = WritePixels(file_name, reference->width, reference->height, pixels);
+	free(pixels);
+	return written;
+}
+
+s32 RunHarness(Scene *scene, ClusterAssets *assets, s32 width, s32 height, const char *output_dir)
+{
+	cluster_assets = assets;
+
+	Camera cameras[] = {
+		MakeCamera(Vec3f(1.0f, 1.0f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f)),
+		MakeCamera(Vec3f(0.0f, 0.0f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f)),
+		MakeCamera(Vec3f(3.0f, 0.0f, 0.5f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f)),
+		MakeCamera(Vec3f(-1.0f, 0.5f, 1.5f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f)),
+	};
+	s32 num_cameras = sizeof(cameras) / sizeof(cameras[0]);
+	s32 num_modes = sizeof(render_modes) / sizeof(render_modes[0]);
+	s32 failures = 0;
+
+	Backbuffer full_reference = { 0 };
+	Backbuffer tier_reference = { 0 };
+	Backbuffer test = { 0 };
+	CreateBackbuffer(&full_reference, width, height);
+	CreateBackbuffer(&tier_reference, width, height);
+	CreateBackbuffer(&test, width, height);
+
+	for (s32 i = 0; i < num_cameras; i++) {
+		// a streamed scene's pages only change between views, so every mode
+		// of a view sees the same ones
+		UpdateSceneTextures(scene);
+		RenderScene(&full_reference, scene, &cameras[i]);
+
+		for (s32 j = 0; j < num_modes; j++) {
+			RenderMode *mode = &render_modes[j];
+			Scene tier = *scene;
+			tier.quality = mode->quality;
+
+			Backbuffer *reference = &full_reference;
+			if (mode->quality != SHADING_FULL) {
+				RenderScene(&tier_reference, &tier, &cameras[i]);
+				reference = &tier_reference;
+			}
+			mode->render(&test, &tier, &cameras[i]);
+
+			CompareStats stats = CompareBackbuffers(reference, &test, mode->threshold);
+			f32 over_ratio = (f32)stats.over_threshold / (f32)stats.num_pixels;
+			b32 passed = stats.rmse <= mode->max_rmse && over_ratio <= mode->max_over_ratio;
+
+			printf("view %d %-16s max %3d rmse %8.4f over %7d/%d %s\n",
+				i, mode->name, stats.max_error, stats.rmse, stats.over_threshold, stats.num_pixels,
+				passed ? "ok" : "FAILED");
+
+			if (!passed) {
+				char file_name[512];
+				if (reference == &full_reference)
+					snprintf(file_name, sizeof(file_name), "%s/view%d_reference.tga", output_dir, i);
+				else
+					snprintf(file_name, sizeof(file_name), "%s/view%d_%s_reference.tga", output_dir, i, mode->name);
+				WriteBackbufferFile(file_name, reference, IMAGE_FORMAT_TGA);
+				snprintf(file_name, sizeof(file_name), "%s/view%d_%s.tga", output_dir, i, mode->name);
+				WriteBackbufferFile(file_name, &test, IMAGE_FORMAT_TGA);
+				snprintf(file_name, sizeof(file_name), "%s/view%d_%s_diff.tga", output_dir, i, mode->name);
+				WriteDiffTGA(file_name, reference, &test);
+				failures++;
+			}
+		}
+	}
+
+	FreeBackbuffer(&full_reference);
+	FreeBackbuffer(&tier_reference);
+	FreeBackbuffer(&test);
+	CloseVirtualMaps();
+	StopCluster();
+
+	return failures;
+}
@@ -0,0 +1,38 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include "types.h"
+
+#include "platform.h"
+#include "scene.h"
+#include "writer.h"
+#include "incremental.h"
+#include "compress.h"
+#include "cluster.h"
+#include "batch.h"
+
+typedef void (*RenderFunc)(Backbuffer *buffer, Scene *scene, Camera *camera);
+
+typedef struct RenderMode {
+	const char *name;
+	RenderFunc render;
+	s32 threshold; // per-channel difference before a pixel counts as wrong
+	f32 max_rmse;
+	f32 max_over_ratio; // fraction of pixels allowed over threshold
+	ShadingQuality quality; // the mode and its reference both render at this tier
+} RenderMode;
+
+typedef struct CompareStats {
+	s32 max_error;
+	f64 rmse;
+	s32 over_threshold;
+	s32 num_pixels;
+} CompareStats;
+
+CompareStats CompareBackbuffers(Backbuffer *reference, Backbuffer *test, s32 threshold);
+b32 WriteDiffTGA(const char *file_name, Backbuffer *reference, Backbuffer *test);
+
+// cluster_assets says how the scene was loaded, for the cluster mode's workers
+s32 RunHarness(Scene *scene, ClusterAssets *cluster_assets, s32 width, s32 height, const char *output_dir);
+
+#endif
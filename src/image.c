@@ -1,74 +1,199 @@
 #include "image.h"
+#include "compress.h"
+#include "vtexture.h"
 
 #pragma warning(disable : 4996)
 
-Image* ReadFromTGA(const char* file_name)
+static volatile LONG image_generation;
+
+Image* ReadFromTGA(const char* file_name, Arena *arena)
 {
 	Image* image;
 	FILE* file;
 	u8 header[18];
 
 	file = fopen(file_name, "rb");
-	assert(file != NULL);
-	fread((void*)header, 1, sizeof(header), file);
+	if (file == NULL)
+		return NULL;
+	if (fread((void*)header, 1, sizeof(header), file) != sizeof(header)) {
+		fclose(file);
+		return NULL;
+	}
 
 	s32 width = header[12] + (header[13] << 8);
 	s32 height = header[14] + (header[15] << 8);
 	s32 depth = header[16];
 	s32 channels = depth >> 3;
+	s32 image_type = header[2];
+	b32 rle = image_type == 10 || image_type == 11;
 
-	if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4))
+	if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4) ||
+		(image_type != 2 && image_type != 3 && !rle)) {
+		fclose(file);
 		return NULL;
+	}
 
-	s32 buffer_size = width * height * channels;
+	// the image id follows the header
+	s64 data_start = sizeof(header) + header[0];
+	_fseeki64(file, 0, SEEK_END);
+	s64 data_size = _ftelli64(file) - data_start;
+	_fseeki64(file, data_start, SEEK_SET);
 
-	image = (Image*)malloc(sizeof(Image));
+	// a header can claim far more pixels than the file holds, so that is
+	// checked before allocating; an rle packet covers at most 128 pixels
+	s64 num_pixels = (s64)width * height;
+	s64 buffer_size = num_pixels * channels;
+	s64 min_data_size = rle ? (num_pixels + 127) / 128 * (1 + channels) : buffer_size;
+	if (data_size < min_data_size) {
+		fclose(file);
+		return NULL;
+	}
+
+	// header and pixels share one allocation
+	size_t header_size = (sizeof(Image) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	size_t mark = arena ? ArenaMark(arena) : 0;
+	u8 *memory = arena ? (u8*)ArenaPushZero(arena, header_size + buffer_size) : (u8*)calloc(1, header_size + buffer_size);
+	if (!memory) {
+		fclose(file);
+		return NULL;
+	}
+
+	image = (Image*)memory;
 	image->width = width;
 	image->height = height;
 	image->channels = channels;
-	image->buffer = (u8*)malloc(buffer_size);
-	memset(image->buffer, 0, buffer_size);
+	image->buffer = memory + header_size;
+	image->in_arena = arena != NULL;
+	image->compression = TEXTURE_UNCOMPRESSED;
+	image->format = TEXTURE_FORMAT_BGR8;
+	TouchImage(image);
 
-	s32 image_type = header[2];
-	if (image_type == 2 || image_type == 3) {
-		fread(image->buffer, 1, sizeof(image->buffer), file);
-	} else if (image_type == 10 || image_type == 11) {
-		s32 buffer_count = 0;
+	b32 ok = true;
+	if (!rle) {
+		ok = fread(image->buffer, 1, (size_t)buffer_size, file) == (size_t)buffer_size;
+	} else {
+		s64 buffer_count = 0;
 		u8 pixel[4];
-		while (buffer_count < buffer_size) {
-			u8 header = (u8)fgetc(file);
-			u32 is_rle_packet = header & 0x80;
-			u32 pixel_count = (header & 0x7F) + 1;
-			u32 expected_size = buffer_count + pixel_count * channels;
-			if (is_rle_packet) { 
-				for (s32 j = 0; j < channels; j++) {
-					pixel[j] = (u8)fgetc(file);
-				}
-				for (s32 i = 0; i < pixel_count; i++) {
-					for (s32 j = 0; j < channels; j++) {
-						image->buffer[buffer_count++] = pixel[j];
-					}
+		while (ok && buffer_count < buffer_size) {
+			s32 packet = fgetc(file);
+			if (packet == EOF) {
+				ok = false;
+				break;
+			}
+
+			// a packet running past the last pixel is cut short
+			s64 pixel_count = min((packet & 0x7F) + 1, (buffer_size - buffer_count) / channels);
+			if (packet & 0x80) {
+				ok = fread(pixel, 1, channels, file) == (size_t)channels;
+				for (s64 i = 0; ok && i < pixel_count; i++) {
+					memcpy(&image->buffer[buffer_count], pixel, channels);
+					buffer_count += channels;
 				}
 			} else {
-				for (s32 i = 0; i < pixel_count; i++) {
-					for (s32 j = 0; j < channels; j++) {
-						image->buffer[buffer_count++] = (u8)fgetc(file);
-					}
-				}
+				size_t size = (size_t)(pixel_count * channels);
+				ok = fread(&image->buffer[buffer_count], 1, size, file) == size;
+				buffer_count += size;
 			}
 		}
-	} else {
-		assert(0);
-		return NULL;
 	}
 	fclose(file);
 
+	if (!ok) {
+		if (arena)
+			ArenaRestore(arena, mark);
+		else
+			free(memory);
+		return NULL;
+	}
+
 	return image;
 }
 
+b32 WriteToTGA(const char *file_name, Image *image)
+{
+	FILE *file;
+	u8 header[18] = { 0 };
+
+	if (image->compression != TEXTURE_UNCOMPRESSED || image->format == TEXTURE_FORMAT_SNORM8X4 || image->virtual_texture)
+		return false;
+
+	file = fopen(file_name, "wb");
+	if (file == NULL)
+		return false;
+
+	header[2] = image->channels == 1 ? 3 : 2;
+	header[12] = image->width & 0xFF;
+	header[13] = (image->width >> 8) & 0xFF;
+	header[14] = image->height & 0xFF;
+	header[15] = (image->height >> 8) & 0xFF;
+	header[16] = (u8)(image->channels << 3);
+	header[17] = image->channels == 4 ? 8 : 0;
+
+	s64 buffer_size = (s64)image->width * image->height * image->channels;
+	b32 written = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+		fwrite(image->buffer, 1, buffer_size, file) == (size_t)buffer_size;
+	fclose(file);
+
+	return written;
+}
+
+Image *ConvertImage(Image *image, TextureFormat format, Arena *arena)
+{
+	assert(image->compression == TEXTURE_UNCOMPRESSED && image->format == TEXTURE_FORMAT_BGR8 && !image->virtual_texture);
+
+	s32 channels = format == TEXTURE_FORMAT_SNORM8X4 ? 4 : format == TEXTURE_FORMAT_R8 ? 1 : image->channels;
+	s64 num_pixels = (s64)image->width * image->height;
+	size_t buffer_size = (size_t)num_pixels * channels;
+
+	size_t header_size = (sizeof(Image) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	u8 *memory = arena ? (u8 *)ArenaPushZero(arena, header_size + buffer_size) : (u8 *)calloc(1, header_size + buffer_size);
+
+	Image *result = (Image *)memory;
+	result->width = image->width;
+	result->height = image->height;
+	result->channels = channels;
+	result->buffer = memory + header_size;
+	result->in_arena = arena != NULL;
+	result->compression = TEXTURE_UNCOMPRESSED;
+	result->format = format;
+	TouchImage(result);
+
+	for (s64 i = 0; i < num_pixels; i++) {
+		u8 *pixel = &image->buffer[i * image->channels];
+		u8 *texel = &result->buffer[i * channels];
+
+		if (format == TEXTURE_FORMAT_SNORM8X4) {
+			// the decode FragmentShader did per fragment, done once
+			vec3 normal;
+			normal.x = pixel[image->channels >= 3 ? 2 : 0] / 255.0f * 2.0f - 1.0f;
+			normal.y = pixel[image->channels >= 3 ? 1 : 0] / 255.0f * 2.0f - 1.0f;
+			normal.z = pixel[0] / 255.0f * 2.0f - 1.0f;
+			normal = Vec3Normalise(normal);
+			texel[0] = (u8)(s8)floorf(normal.x * 127.0f + 0.5f);
+			texel[1] = (u8)(s8)floorf(normal.y * 127.0f + 0.5f);
+			texel[2] = (u8)(s8)floorf(normal.z * 127.0f + 0.5f);
+			texel[3] = 0;
+		} else if (format == TEXTURE_FORMAT_R8) {
+			texel[0] = pixel[0];
+		} else {
+			memcpy(texel, pixel, channels);
+		}
+	}
+
+	return result;
+}
+
 void FreeImage(Image *image)
 {
-	free(image);
+	if (image && !image->in_arena)
+		free(image);
+}
+
+void TouchImage(Image *image)
+{
+	// images load on job threads, and a freed image's address can come back
+	// for the next one, so generations are global rather than per image
+	image->generation = (u32)InterlockedIncrement(&image_generation);
 }
 
 static vec3 GetColour(Image *image, int x, int y)
@@ -87,9 +212,40 @@ static vec3 GetColour(Image *image, int x, int y)
 	return color;
 }
 
+static u8 *GetTexel(Image *texture, vec2 texcoord)
+{
+	s32 x = (s32)(texcoord.x * (texture->width - 1) + 0.5f);
+	s32 y = (s32)(texcoord.y * (texture->height - 1) + 0.5f);
+	return &texture->buffer[((s64)y * texture->width + x) * texture->channels];
+}
+
 vec3 SampleTexture(Image *texture, vec2 texcoord)
 {
 	float x = (s32)(texcoord.x * (texture->width - 1) + 0.5f);
 	float y = (s32)(texcoord.y * (texture->height - 1) + 0.5f);
-	GetColour(texture, y, x);
+	if (texture->compression != TEXTURE_UNCOMPRESSED)
+		return GetCompressedColour(texture, (s32)x, (s32)y);
+	if (texture->virtual_texture)
+		return SampleVirtualTexture(texture->virtual_texture, (s32)x, (s32)y);
+
+	if (texture->format == TEXTURE_FORMAT_SNORM8X4) {
+		vec3 normal = SampleNormal(texture, texcoord);
+		return Vec3f((normal.x + 1.0f) * 127.5f, (normal.y + 1.0f) * 127.5f, (normal.z + 1.0f) * 127.5f);
+	}
+	if (texture->format == TEXTURE_FORMAT_R8) {
+		f32 value = SampleR8(texture, texcoord);
+		return Vec3f(value, value, value);
+	}
+	return GetColour(texture, y, x);
+}
+
+vec3 SampleNormal(Image *texture, vec2 texcoord)
+{
+	s8 *texel = (s8 *)GetTexel(texture, texcoord);
+	return Vec3f(texel[0] / 127.0f, texel[1] / 127.0f, texel[2] / 127.0f);
+}
+
+f32 SampleR8(Image *texture, vec2 texcoord)
+{
+	return *GetTexel(texture, texcoord);
 }
\ No newline at end of file
@@ -8,16 +8,51 @@
 
 #include "types.h"
 #include "maths.h"
+#include "arena.h"
+
+typedef enum TextureCompression {
+	TEXTURE_UNCOMPRESSED,
+	TEXTURE_BC1, // 8 bytes per 4x4 block: two 5:6:5 endpoints, 2 bit indices
+	TEXTURE_BC3, // 16 bytes per block: bc1 colour after an 8 bit alpha block
+} TextureCompression;
+
+// how uncompressed pixels are laid out; the typed formats are decoded
+// once by ConvertImage so shaders fetch only what they use
+typedef enum TextureFormat {
+	TEXTURE_FORMAT_BGR8, // as read from a tga: b, g, r, a by channels, or grey
+	TEXTURE_FORMAT_SNORM8X4, // unit normal as x, y, z * 127, then padding
+	TEXTURE_FORMAT_R8, // one channel, the b (first) channel of the source
+} TextureFormat;
 
 typedef struct Image
 {
 	s32 width, height, channels;
-	u8 *buffer;
+	u8 *buffer; // pixels, or blocks in rows of (width + 3) / 4
+	b32 in_arena;
+	TextureCompression compression;
+	TextureFormat format;
+	struct VirtualTexture *virtual_texture; // pages streamed in as sampled, no buffer
+	u32 generation; // unique per load or change, what derived caches key on
 } Image;
 
-Image *ReadFromTGA(const char* file_name);
+// with a NULL arena the image is a single malloc block released by FreeImage;
+// NULL for a missing, truncated or unsupported file, nothing is left
+// allocated from the arena then
+Image *ReadFromTGA(const char* file_name, Arena *arena);
+b32 WriteToTGA(const char *file_name, Image *image);
 void FreeImage(Image *image);
+// gives the image a new generation; call after changing pixels in place,
+// and only between frames, caches built from it are not rebuilt mid frame
+void TouchImage(Image *image);
+
+// copies an uncompressed bgr8 image into format, with the same arena
+// rules as ReadFromTGA
+Image *ConvertImage(Image *image, TextureFormat format, Arena *arena);
 
+// any format, as 0-255 rgb
 vec3 SampleTexture(Image *texture, vec2 texcoord);
+// typed fetches, texture must already be in the matching format
+vec3 SampleNormal(Image *texture, vec2 texcoord);
+f32 SampleR8(Image *texture, vec2 texcoord);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,245 @@
+#include "incremental.h"
+
+// redrawing more than this share of the tiles costs about as much as a
+// full frame
+#define MAX_PARTIAL_TILE_RATIO 0.5f
+
+static void AllocateTiles(IncrementalRenderer *renderer, s32 width, s32 height)
+{
+	renderer->tiles_x = (width + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+	renderer->tiles_y = (height + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+	renderer->dirty_tiles = (u8 *)malloc(max(renderer->tiles_x * renderer->tiles_y, 1));
+}
+
+void CreateIncrementalRenderer(IncrementalRenderer *renderer, s32 width, s32 height)
+{
+	memset(renderer, 0, sizeof(IncrementalRenderer));
+	CreateBackbuffer(&renderer->canvas, width, height);
+	AllocateTiles(renderer, width, height);
+}
+
+void DestroyIncrementalRenderer(IncrementalRenderer *renderer)
+{
+	FreeBackbuffer(&renderer->canvas);
+	free(renderer->dirty_tiles);
+}
+
+void CopyBackbuffer(Backbuffer *buffer, Backbuffer *source)
+{
+	assert(buffer->width == source->width && buffer->height == source->height);
+	memcpy(buffer->memory, source->memory, (s64)source->width * (s64)source->height * sizeof(s32));
+}
+
+static FrameKey MakeFrameKey(Scene *scene, Camera *camera)
+{
+	FrameKey key;
+	memset(&key, 0, sizeof(key)); // padding takes part in the memcmp
+	key.camera = *camera;
+	key.light = scene->light;
+	key.lighting_cache = scene->lighting_cache;
+	key.shadow_map = scene->shadow_map;
+	key.quality = scene->quality;
+
+	// generations rather than addresses, so a map touched in place or
+	// replaced at the same address still redraws the frame
+	Image *maps[3] = { scene->diffuse_map, scene->normal_map, scene->specular_map };
+	for (s32 i = 0; i < 3; i++) {
+		key.map_generations[i] = maps[i]->generation;
+		if (maps[i]->virtual_texture)
+			key.texture_version += maps[i]->virtual_texture->version;
+	}
+	return key;
+}
+
+static b32 SameObject(SceneObject *left, SceneObject *right)
+{
+	return left->model == right->model && left->version == right->version &&
+		memcmp(&left->transform, &right->transform, sizeof(mat4)) == 0;
+}
+
+// screen rectangle around the object's bounding box, the whole screen when
+// part of it is behind the eye
+static ScreenRect ObjectBounds(SceneObject *object, mat4 view_projection, mat4 viewport, s32 width, s32 height)
+{
+	ScreenRect rect = { 0, 0, width, height };
+	Model *model = object->model;
+	mat4 mvp = Mat4Multiply(object->transform, view_projection);
+
+	if (!SphereInFrustum(mvp, model->centre, model->radius)) {
+		ScreenRect empty = { 0, 0, 0, 0 };
+		return empty;
+	}
+
+	f32 lower_x = FLT_MAX, lower_y = FLT_MAX;
+	f32 upper_x = -FLT_MAX, upper_y = -FLT_MAX;
+	for (s32 i = 0; i < 8; i++) {
+		vec4 corner = Vec4f(
+			model->centre.x + ((i & 1) ? model->radius : -model->radius),
+			model->centre.y + ((i & 2) ? model->radius : -model->radius),
+			model->centre.z + ((i & 4) ? model->radius : -model->radius),
+			1.0f);
+		vec4 clip = Mat4MultiplyVec4(mvp, corner);
+		if (clip.w <= 1e-6f)
+			return rect;
+		vec4 screen = Mat4MultiplyVec4(viewport, Vec4f(clip.x / clip.w, clip.y / clip.w, clip.z / clip.w, 1.0f));
+		lower_x = min(lower_x, screen.x);
+		lower_y = min(lower_y, screen.y);
+		upper_x = max(upper_x, screen.x);
+		upper_y = max(upper_y, screen.y);
+	}
+
+	// a pixel of slack for the truncation in Draw
+	rect.x0 = max(0, (s32)floorf(lower_x) - 1);
+	rect.y0 = max(0, (s32)floorf(lower_y) - 1);
+	rect.x1 = min(width, (s32)ceilf(upper_x) + 2);
+	rect.y1 = min(height, (s32)ceilf(upper_y) + 2);
+	return rect;
+}
+
+static void MarkTiles(IncrementalRenderer *renderer, ScreenRect rect)
+{
+	if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1)
+		return;
+	for (s32 y = rect.y0 / DIRTY_TILE_SIZE; y <= (rect.y1 - 1) / DIRTY_TILE_SIZE; y++) {
+		for (s32 x = rect.x0 / DIRTY_TILE_SIZE; x <= (rect.x1 - 1) / DIRTY_TILE_SIZE; x++)
+			renderer->dirty_tiles[y * renderer->tiles_x + x] = 1;
+	}
+}
+
+static b32 Overlaps(ScreenRect left, ScreenRect right)
+{
+	return left.x0 < right.x1 && right.x0 < left.x1 && left.y0 < right.y1 && right.y0 < left.y1;
+}
+
+static void DrawObjects(Backbuffer *buffer, Program *program, mat4 viewport, SceneObject *objects, ScreenRect *bounds, s32 num_objects, ScreenRect region)
+{
+	Uniforms *uniforms = (Uniforms *)program->uniforms;
+	mat4 view_projection = uniforms->mvp;
+	mat4 view_projection_inverse = uniforms->mvp_inverse;
+
+	for (s32 i = 0; i < num_objects; i++) {
+		if (!Overlaps(bounds[i], region))
+			continue;
+		mat4 mvp = Mat4Multiply(objects[i].transform, view_projection);
+		uniforms->mvp = mvp;
+		uniforms->mvp_inverse = Mat4InverseTranspose(mvp);
+		DrawModel(buffer, program, viewport, objects[i].model);
+	}
+
+	uniforms->mvp = view_projection;
+	uniforms->mvp_inverse = view_projection_inverse;
+}
+
+FrameUpdate RenderIncremental(IncrementalRenderer *renderer, Scene *scene, Camera *camera, SceneObject *objects, s32 num_objects, s32 width, s32 height)
+{
+	Backbuffer *canvas = &renderer->canvas;
+
+	// the uniforms are set up first, streamed pages they commit count as a
+	// change to the frame
+	Varyings varyings;
+	Uniforms uniforms;
+	Program program;
+	program.varyings = &varyings;
+	program.uniforms = &uniforms;
+	SetupUniforms(&uniforms, scene, camera);
+	program.num_varyings = NumVaryings(&uniforms);
+
+	FrameKey key = MakeFrameKey(scene, camera);
+	b32 full = !renderer->valid || num_objects > MAX_TRACKED_OBJECTS ||
+		memcmp(&key, &renderer->key, sizeof(FrameKey)) != 0;
+
+	if (width != canvas->width || height != canvas->height) {
+		FreeBackbuffer(canvas);
+		CreateBackbuffer(canvas, width, height);
+		free(renderer->dirty_tiles);
+		AllocateTiles(renderer, width, height);
+		full = true;
+	}
+
+	mat4 viewport = Viewport(0, 0, width, height);
+
+	num_objects = min(num_objects, MAX_TRACKED_OBJECTS);
+	ScreenRect bounds[MAX_TRACKED_OBJECTS];
+	for (s32 i = 0; i < num_objects; i++)
+		bounds[i] = ObjectBounds(&objects[i], uniforms.mvp, viewport, width, height);
+
+	FrameUpdate update = FRAME_FULL;
+	if (!full) {
+		// old and new footprints of every object that changed, appeared or
+		// went away
+		s32 num_tiles = renderer->tiles_x * renderer->tiles_y;
+		memset(renderer->dirty_tiles, 0, num_tiles);
+		for (s32 i = 0; i < max(num_objects, renderer->num_objects); i++) {
+			b32 old_exists = i < renderer->num_objects;
+			b32 new_exists = i < num_objects;
+			if (old_exists && new_exists && SameObject(&objects[i], &renderer->objects[i]))
+				continue;
+			if (old_exists)
+				MarkTiles(renderer, renderer->bounds[i]);
+			if (new_exists)
+				MarkTiles(renderer, bounds[i]);
+		}
+
+		s32 num_dirty = 0;
+		for (s32 i = 0; i < num_tiles; i++)
+			num_dirty += renderer->dirty_tiles[i];
+
+		if (num_dirty == 0) {
+			update = FRAME_UNCHANGED;
+		} else if (num_dirty <= num_tiles * MAX_PARTIAL_TILE_RATIO) {
+			update = FRAME_PARTIAL;
+			renderer->tiles_redrawn += num_dirty;
+
+			// runs of dirty tiles along a row are redrawn as one clip rect
+			ResetArena(&canvas->scratch);
+			for (s32 ty = 0; ty < renderer->tiles_y; ty++) {
+				for (s32 tx = 0; tx < renderer->tiles_x;) {
+					if (!renderer->dirty_tiles[ty * renderer->tiles_x + tx]) {
+						tx++;
+						continue;
+					}
+					s32 run = tx;
+					while (run < renderer->tiles_x && renderer->dirty_tiles[ty * renderer->tiles_x + run])
+						run++;
+
+					ScreenRect region;
+					region.x0 = tx * DIRTY_TILE_SIZE;
+					region.y0 = ty * DIRTY_TILE_SIZE;
+					region.x1 = min(width, run * DIRTY_TILE_SIZE);
+					region.y1 = min(height, (ty + 1) * DIRTY_TILE_SIZE);
+
+					for (s32 y = region.y0; y < region.y1; y++) {
+						memset((s32 *)canvas->memory + y * width + region.x0, 0, sizeof(s32) * (region.x1 - region.x0));
+						memset(canvas->zbuffer + y * width + region.x0, 0, sizeof(f32) * (region.x1 - region.x0));
+					}
+					SetClipRect(canvas, region.x0, region.y0, region.x1, region.y1);
+					DrawObjects(canvas, &program, viewport, objects, bounds, num_objects, region);
+
+					tx = run;
+				}
+			}
+			ResetClipRect(canvas);
+		}
+	}
+
+	if (update == FRAME_FULL) {
+		ScreenRect screen = { 0, 0, width, height };
+		ClearBackbuffer(canvas);
+		DrawObjects(canvas, &program, viewport, objects, bounds, num_objects, screen);
+	}
+
+	if (update == FRAME_UNCHANGED)
+		renderer->frames_unchanged++;
+	else if (update == FRAME_PARTIAL)
+		renderer->frames_partial++;
+	else
+		renderer->frames_full++;
+
+	renderer->key = key;
+	memcpy(renderer->objects, objects, sizeof(SceneObject) * num_objects);
+	memcpy(renderer->bounds, bounds, sizeof(ScreenRect) * num_objects);
+	renderer->num_objects = num_objects;
+	renderer->valid = true;
+
+	return update;
+}
@@ -0,0 +1,77 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <float.h>
+
+#include "types.h"
+#include "maths.h"
+
+#include "platform.h"
+#include "scene.h"
+
+#define MAX_TRACKED_OBJECTS 256
+#define DIRTY_TILE_SIZE 32
+
+// one drawable the incremental renderer tracks between frames; bump
+// version after editing the model's vertices in place
+typedef struct SceneObject {
+	Model *model;
+	mat4 transform;
+	u32 version;
+} SceneObject;
+
+typedef struct ScreenRect {
+	s32 x0, y0;
+	s32 x1, y1; // exclusive, empty when x0 >= x1
+} ScreenRect;
+
+typedef enum FrameUpdate {
+	FRAME_UNCHANGED, // canvas still holds this frame
+	FRAME_PARTIAL,   // only tiles under changed objects were redrawn
+	FRAME_FULL,
+} FrameUpdate;
+
+// everything outside the object list that a frame depends on
+typedef struct FrameKey {
+	Camera camera;
+	vec3 light;
+	u32 map_generations[3]; // diffuse, normal, specular
+	LightingCache *lighting_cache;
+	ShadowMap *shadow_map;
+	ShadingQuality quality;
+	s64 texture_version; // pages streamed into virtual maps
+} FrameKey;
+
+// keeps the last frame in its own canvas and works out what has to be
+// redrawn from what changed since
+typedef struct IncrementalRenderer {
+	Backbuffer canvas;
+	b32 valid;
+
+	FrameKey key;
+	SceneObject objects[MAX_TRACKED_OBJECTS];
+	ScreenRect bounds[MAX_TRACKED_OBJECTS];
+	s32 num_objects;
+
+	u8 *dirty_tiles;
+	s32 tiles_x, tiles_y;
+
+	// stats
+	s64 frames_unchanged;
+	s64 frames_partial;
+	s64 frames_full;
+	s64 tiles_redrawn;
+} IncrementalRenderer;
+
+void CreateIncrementalRenderer(IncrementalRenderer *renderer, s32 width, s32 height);
+void DestroyIncrementalRenderer(IncrementalRenderer *renderer);
+
+// brings renderer->canvas up to date with the scene's maps and light, the
+// camera and the objects; a size change or anything beyond the objects
+// redraws everything
+FrameUpdate RenderIncremental(IncrementalRenderer *renderer, Scene *scene, Camera *camera, SceneObject *objects, s32 num_objects, s32 width, s32 height);
+
+// copies the colour of source into buffer, both the same size
+void CopyBackbuffer(Backbuffer *buffer, Backbuffer *source);
+
+#endif
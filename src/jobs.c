@@ -0,0 +1,308 @@
+#include "jobs.h"
+
+#define SPIN_COUNT 64
+
+typedef struct RangeJob {
+	RangeFunc func;
+	void *data;
+	s32 start;
+	s32 end;
+} RangeJob;
+
+s32 GetProcessorCount(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (s32)info.dwNumberOfProcessors;
+}
+
+s32 GetWorkerIndex(JobSystem *system)
+{
+	return (s32)(intptr_t)TlsGetValue(system->tls_index) - 1;
+}
+
+static void PushJob(JobQueue *queue, Job *job)
+{
+	LONG64 bottom = queue->bottom;
+	assert(bottom - queue->top < JOB_QUEUE_SIZE);
+	queue->jobs[bottom & (JOB_QUEUE_SIZE - 1)] = job;
+	MemoryBarrier();
+	queue->bottom = bottom + 1;
+}
+
+static Job *PopJob(JobQueue *queue)
+{
+	LONG64 bottom = queue->bottom - 1;
+	InterlockedExchange64(&queue->bottom, bottom);
+	LONG64 top = queue->top;
+
+	if (top > bottom) {
+		queue->bottom = top;
+		return NULL;
+	}
+
+	Job *job = queue->jobs[bottom & (JOB_QUEUE_SIZE - 1)];
+	if (top != bottom)
+		return job;
+
+	// last job in the queue, race the thieves for it
+	if (InterlockedCompareExchange64(&queue->top, top + 1, top) != top)
+		job = NULL;
+	queue->bottom = top + 1;
+	return job;
+}
+
+static Job *StealJob(JobQueue *queue)
+{
+	LONG64 top = queue->top;
+	MemoryBarrier();
+	LONG64 bottom = queue->bottom;
+
+	if (top >= bottom)
+		return NULL;
+
+	Job *job = queue->jobs[top & (JOB_QUEUE_SIZE - 1)];
+	if (InterlockedCompareExchange64(&queue->top, top + 1, top) != top)
+		return NULL;
+	return job;
+}
+
+static Job *TakeInjectedJob(JobSystem *system)
+{
+	Job *job = NULL;
+
+	if (system->injected_head == system->injected_tail)
+		return NULL;
+
+	EnterCriticalSection(&system->injected_lock);
+	if (system->injected_head != system->injected_tail) {
+		job = system->injected[system->injected_head & (JOB_QUEUE_SIZE - 1)];
+		system->injected_head++;
+	}
+	LeaveCriticalSection(&system->injected_lock);
+
+	return job;
+}
+
+static Job *FindJob(JobSystem *system, s32 worker)
+{
+	Job *job = PopJob(&system->queues[worker]);
+	if (job)
+		return job;
+
+	job = TakeInjectedJob(system);
+	if (job)
+		return job;
+
+	for (s32 i = 1; i < system->num_workers; i++) {
+		job = StealJob(&system->queues[(worker + i) % system->num_workers]);
+		if (job)
+			return job;
+	}
+
+	return NULL;
+}
+
+static void FinishJob(JobSystem *system, Job *job)
+{
+	if (InterlockedDecrement(&job->unfinished) > 0)
+		return;
+
+	if (job->parent) {
+		FinishJob(system, job->parent);
+	} else {
+		EnterCriticalSection(&system->finished_lock);
+		WakeAllConditionVariable(&system->job_finished);
+		LeaveCriticalSection(&system->finished_lock);
+	}
+}
+
+static void ExecuteJob(JobSystem *system, Job *job, s32 worker)
+{
+	if (job->func)
+		job->func(job->data, worker);
+	FinishJob(system, job);
+}
+
+static DWORD WINAPI WorkerThread(LPVOID data)
+{
+	JobSystem *system = (JobSystem *)data;
+	s32 worker = InterlockedIncrement(&system->next_worker) - 1;
+	TlsSetValue(system->tls_index, (void *)(intptr_t)(worker + 1));
+
+	while (system->running) {
+		Job *job = NULL;
+		for (s32 i = 0; i < SPIN_COUNT && !job; i++) {
+			job = FindJob(system, worker);
+			if (!job)
+				YieldProcessor();
+		}
+
+		if (!job) {
+			// announce we're going to sleep, then look once more so a push
+			// that missed the announcement can't be lost
+			InterlockedIncrement(&system->num_sleeping);
+			job = FindJob(system, worker);
+			if (!job && system->running)
+				WaitForSingleObject(system->work_available, INFINITE);
+			InterlockedDecrement(&system->num_sleeping);
+		}
+
+		if (job)
+			ExecuteJob(system, job, worker);
+	}
+
+	return 0;
+}
+
+void CreateJobSystem(JobSystem *system, s32 num_workers, b32 pin)
+{
+	memset(system, 0, sizeof(JobSystem));
+
+	if (num_workers <= 0)
+		num_workers = GetProcessorCount();
+	system->num_workers = min(num_workers, MAX_WORKERS);
+
+	system->queues = (JobQueue *)VirtualAlloc(0, sizeof(JobQueue) * system->num_workers, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	system->jobs = (Job *)VirtualAlloc(0, sizeof(Job) * MAX_JOBS, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	InitializeCriticalSection(&system->injected_lock);
+	InitializeCriticalSection(&system->finished_lock);
+	InitializeConditionVariable(&system->job_finished);
+	system->work_available = CreateSemaphore(NULL, 0, MAX_WORKERS, NULL);
+	system->tls_index = TlsAlloc();
+
+	system->running = true;
+	for (s32 i = 0; i < system->num_workers; i++) {
+		system->threads[i] = CreateThread(NULL, 0, WorkerThread, system, 0, NULL);
+		if (pin)
+			SetThreadAffinityMask(system->threads[i], (DWORD_PTR)1 << (i % GetProcessorCount()));
+	}
+}
+
+void DestroyJobSystem(JobSystem *system)
+{
+	InterlockedExchange(&system->running, 0);
+	ReleaseSemaphore(system->work_available, system->num_workers, NULL);
+
+	for (s32 i = 0; i < system->num_workers; i++) {
+		WaitForSingleObject(system->threads[i], INFINITE);
+		CloseHandle(system->threads[i]);
+	}
+
+	CloseHandle(system->work_available);
+	TlsFree(system->tls_index);
+	DeleteCriticalSection(&system->injected_lock);
+	DeleteCriticalSection(&system->finished_lock);
+	VirtualFree(system->queues, 0, MEM_RELEASE);
+	VirtualFree(system->jobs, 0, MEM_RELEASE);
+}
+
+Job *CreateJob(JobSystem *system, JobFunc func, void *data)
+{
+	LONG index = InterlockedIncrement(&system->next_job) - 1;
+	Job *job = &system->jobs[index & (MAX_JOBS - 1)];
+	assert(job->unfinished == 0);
+
+	// the new generation is visible before the job counts as unfinished,
+	// so a waiter on the old one never sees it running again
+	InterlockedIncrement(&job->generation);
+	job->func = func;
+	job->data = data;
+	job->parent = NULL;
+	job->unfinished = 1;
+	return job;
+}
+
+Job *CreateChildJob(JobSystem *system, Job *parent, JobFunc func, void *data)
+{
+	InterlockedIncrement(&parent->unfinished);
+	Job *job = CreateJob(system, func, data);
+	job->parent = parent;
+	return job;
+}
+
+void RunJob(JobSystem *system, Job *job)
+{
+	s32 worker = GetWorkerIndex(system);
+
+	if (worker >= 0) {
+		PushJob(&system->queues[worker], job);
+	} else {
+		EnterCriticalSection(&system->injected_lock);
+		assert(system->injected_tail - system->injected_head < JOB_QUEUE_SIZE);
+		system->injected[system->injected_tail & (JOB_QUEUE_SIZE - 1)] = job;
+		system->injected_tail++;
+		LeaveCriticalSection(&system->injected_lock);
+	}
+
+	MemoryBarrier();
+	if (system->num_sleeping > 0)
+		ReleaseSemaphore(system->work_available, 1, NULL);
+}
+
+JobHandle GetJobHandle(Job *job)
+{
+	JobHandle handle;
+	handle.job = job;
+	handle.generation = job->generation;
+	return handle;
+}
+
+static b32 JobPending(JobHandle handle)
+{
+	return handle.job->unfinished > 0 && handle.job->generation == handle.generation;
+}
+
+// workers keep executing other jobs while they wait, outside threads block
+void WaitForJob(JobSystem *system, JobHandle handle)
+{
+	s32 worker = GetWorkerIndex(system);
+
+	if (worker >= 0) {
+		while (JobPending(handle)) {
+			Job *next = FindJob(system, worker);
+			if (next)
+				ExecuteJob(system, next, worker);
+			else
+				YieldProcessor();
+		}
+	} else {
+		EnterCriticalSection(&system->finished_lock);
+		while (JobPending(handle))
+			SleepConditionVariableCS(&system->job_finished, &system->finished_lock, INFINITE);
+		LeaveCriticalSection(&system->finished_lock);
+	}
+}
+
+static void RangeJobFunc(void *data, s32 worker)
+{
+	RangeJob *range = (RangeJob *)data;
+	range->func(range->data, range->start, range->end, worker);
+}
+
+void ParallelFor(JobSystem *system, s32 count, s32 grain, RangeFunc func, void *data)
+{
+	if (count <= 0)
+		return;
+
+	// a few chunks per worker leaves room to balance uneven work
+	if (grain <= 0)
+		grain = max(1, count / (system->num_workers * 4));
+	grain = max(grain, (count + JOB_QUEUE_SIZE / 2 - 1) / (JOB_QUEUE_SIZE / 2));
+
+	Job *root = CreateJob(system, NULL, NULL);
+	JobHandle handle = GetJobHandle(root);
+	for (s32 start = 0; start < count; start += grain) {
+		Job *job = CreateChildJob(system, root, RangeJobFunc, NULL);
+		RangeJob *range = (RangeJob *)job->payload;
+		range->func = func;
+		range->data = data;
+		range->start = start;
+		range->end = min(start + grain, count);
+		job->data = range;
+		RunJob(system, job);
+	}
+	FinishJob(system, root);
+	WaitForJob(system, handle);
+}
@@ -0,0 +1,88 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <windows.h>
+#include <assert.h>
+#include <string.h>
+
+#include "types.h"
+
+#define MAX_WORKERS 64
+#define MAX_JOBS 65536 // jobs in flight, the pool is reused as a ring
+#define JOB_QUEUE_SIZE 4096
+#define JOB_PAYLOAD_SIZE 24
+
+typedef void (*JobFunc)(void *data, s32 worker);
+typedef void (*RangeFunc)(void *data, s32 start, s32 end, s32 worker);
+
+// a job is finished once it has run and all of its children have finished
+typedef struct Job {
+	JobFunc func;
+	void *data;
+	struct Job *parent;
+	volatile LONG unfinished;
+	volatile LONG generation; // bumped each time the slot is reused
+	u8 payload[JOB_PAYLOAD_SIZE];
+} Job;
+
+// what to wait on: the slot of a finished job goes back into the ring, so
+// a bare pointer may already name a newer job by the time it is waited on
+typedef struct JobHandle {
+	Job *job;
+	LONG generation;
+} JobHandle;
+
+// chase-lev deque: the owning worker pushes and pops at the bottom,
+// everyone else steals from the top
+typedef struct JobQueue {
+	Job *jobs[JOB_QUEUE_SIZE];
+	volatile LONG64 top;
+	volatile LONG64 bottom;
+} JobQueue;
+
+typedef struct JobSystem {
+	HANDLE threads[MAX_WORKERS];
+	JobQueue *queues;
+	s32 num_workers;
+	volatile LONG running;
+	volatile LONG next_worker;
+
+	Job *jobs;
+	volatile LONG next_job;
+
+	// jobs submitted from threads outside the pool
+	Job *injected[JOB_QUEUE_SIZE];
+	s32 injected_head;
+	s32 injected_tail;
+	CRITICAL_SECTION injected_lock;
+
+	// idle workers sleep on the semaphore, outside threads on the condition
+	HANDLE work_available;
+	volatile LONG num_sleeping;
+	CRITICAL_SECTION finished_lock;
+	CONDITION_VARIABLE job_finished;
+
+	DWORD tls_index;
+} JobSystem;
+
+s32 GetProcessorCount(void);
+
+// num_workers <= 0 uses one worker per processor; pin locks worker i to processor i
+void CreateJobSystem(JobSystem *system, s32 num_workers, b32 pin);
+void DestroyJobSystem(JobSystem *system);
+
+Job *CreateJob(JobSystem *system, JobFunc func, void *data);
+Job *CreateChildJob(JobSystem *system, Job *parent, JobFunc func, void *data);
+void RunJob(JobSystem *system, Job *job);
+// taken before RunJob, while the job can not have finished yet
+JobHandle GetJobHandle(Job *job);
+// returns at once if the slot has moved on to another job since
+void WaitForJob(JobSystem *system, JobHandle handle);
+
+// splits [0, count) into chunks of at least grain (0 picks one) and waits
+void ParallelFor(JobSystem *system, s32 count, s32 grain, RangeFunc func, void *data);
+
+// index of the calling worker, -1 for threads outside the pool
+s32 GetWorkerIndex(JobSystem *system);
+
+#endif
@@ -0,0 +1,90 @@
+#include "lighting.h"
+
+f32 baked_normal_decode[256];
+
+void CreateLightingCache(LightingCache *cache)
+{
+	memset(cache, 0, sizeof(LightingCache));
+	InitializeCriticalSection(&cache->lock);
+
+	// same expression as the decode in FragmentShader, so results match
+	for (s32 i = 0; i < 256; i++)
+		baked_normal_decode[i] = i / 255.0f * 2.0f - 1.0f;
+}
+
+void DestroyLightingCache(LightingCache *cache)
+{
+	free(cache->texels);
+	DeleteCriticalSection(&cache->lock);
+}
+
+static void BakeLighting(LightingCache *cache, Image *diffuse_map, Image *normal_map, Image *specular_map)
+{
+	// baked at the largest map, so with equally sized maps every texel
+	// holds exactly what FragmentShader would have sampled
+	s32 width = max(diffuse_map->width, max(normal_map->width, specular_map->width));
+	s32 height = max(diffuse_map->height, max(normal_map->height, specular_map->height));
+
+	if (width != cache->width || height != cache->height) {
+		free(cache->texels);
+		cache->texels = (BakedTexel *)malloc(sizeof(BakedTexel) * width * height);
+		cache->width = width;
+		cache->height = height;
+	}
+
+	for (s32 y = 0; y < height; y++) {
+		for (s32 x = 0; x < width; x++) {
+			vec2 texcoord = Vec2f((f32)x / max(width - 1, 1), (f32)y / max(height - 1, 1));
+			BakedTexel *texel = &cache->texels[y * width + x];
+
+			vec3 colour = SampleTexture(diffuse_map, texcoord);
+			texel->albedo[0] = (u8)colour.r;
+			texel->albedo[1] = (u8)colour.g;
+			texel->albedo[2] = (u8)colour.b;
+
+			texel->specular = (u8)SampleTexture(specular_map, texcoord).b;
+
+			vec3 normal = SampleTexture(normal_map, texcoord);
+			texel->normal[0] = (u8)normal.r;
+			texel->normal[1] = (u8)normal.g;
+			texel->normal[2] = (u8)normal.b;
+			texel->pad = 0;
+		}
+	}
+
+	cache->num_bakes++;
+}
+
+b32 UpdateLightingCache(LightingCache *cache, Image *diffuse_map, Image *normal_map, Image *specular_map)
+{
+	b32 baked = false;
+	u32 generations[3] = { diffuse_map->generation, normal_map->generation, specular_map->generation };
+
+	if (memcmp(cache->generations, generations, sizeof(generations)) == 0)
+		return false;
+
+	EnterCriticalSection(&cache->lock);
+	if (memcmp(cache->generations, generations, sizeof(generations)) != 0) {
+		BakeLighting(cache, diffuse_map, normal_map, specular_map);
+
+		// a map touched while it was being baked means it changed mid frame
+		assert(diffuse_map->generation == generations[0] && normal_map->generation == generations[1] &&
+			specular_map->generation == generations[2]);
+
+		// the key is published last, the unlocked check above must not see
+		// it before the texels
+		MemoryBarrier();
+		memcpy(cache->generations, generations, sizeof(generations));
+		baked = true;
+	}
+	LeaveCriticalSection(&cache->lock);
+
+	return baked;
+}
+
+BakedTexel *SampleLightingCache(LightingCache *cache, vec2 texcoord)
+{
+	s32 x = (s32)(texcoord.x * (cache->width - 1) + 0.5f);
+	s32 y = (s32)(texcoord.y * (cache->height - 1) + 0.5f);
+	return &cache->texels[y * cache->width + x];
+}
@@ -0,0 +1,51 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <windows.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "maths.h"
+
+#include "image.h"
+
+// the three maps FragmentShader samples, interleaved so a pixel touches one
+// cache line instead of three; kept at 8 bits, float texels are bigger
+// than the maps and lose more to memory traffic than the decode costs
+typedef struct BakedTexel {
+	u8 albedo[3]; // r, g, b
+	u8 specular; // exponent
+	u8 normal[3]; // x, y, z encoded as in the normal map
+	u8 pad;
+} BakedTexel;
+
+// decoded normal component for each encoded value
+extern f32 baked_normal_decode[256];
+
+// uv space bake of the view independent inputs to FragmentShader, keyed on
+// the generations of the maps it was built from; the light is transformed
+// by the mvp along with the normal there, so no light term survives a
+// change of view
+typedef struct LightingCache {
+	BakedTexel *texels;
+	s32 width, height;
+
+	u32 generations[3]; // diffuse, normal, specular
+
+	CRITICAL_SECTION lock;
+	s32 num_bakes;
+} LightingCache;
+
+void CreateLightingCache(LightingCache *cache);
+void DestroyLightingCache(LightingCache *cache);
+
+// rebakes if any map has a new generation since the last bake, safe to
+// call from several render threads at once; maps only change between
+// frames, a rebake frees texels other threads may still be sampling.
+// returns true if it baked
+b32 UpdateLightingCache(LightingCache *cache, Image *diffuse_map, Image *normal_map, Image *specular_map);
+
+// nearest texel, addressed the same way as SampleTexture
+BakedTexel *SampleLightingCache(LightingCache *cache, vec2 texcoord);
+
+#endif
@@ -0,0 +1,291 @@
+#include "lod.h"
+#include "mesh.h"
+
+typedef struct Quadric {
+	f64 a2, ab, ac, ad;
+	f64 b2, bc, bd;
+	f64 c2, cd;
+	f64 d2;
+} Quadric;
+
+typedef struct Collapse {
+	f64 cost;
+	s32 from;
+	s32 to;
+} Collapse;
+
+static void AddPlane(Quadric *q, f64 a, f64 b, f64 c, f64 d)
+{
+	q->a2 += a * a; q->ab += a * b; q->ac += a * c; q->ad += a * d;
+	q->b2 += b * b; q->bc += b * c; q->bd += b * d;
+	q->c2 += c * c; q->cd += c * d;
+	q->d2 += d * d;
+}
+
+static Quadric AddQuadrics(Quadric *left, Quadric *right)
+{
+	Quadric result;
+	result.a2 = left->a2 + right->a2; result.ab = left->ab + right->ab;
+	result.ac = left->ac + right->ac; result.ad = left->ad + right->ad;
+	result.b2 = left->b2 + right->b2; result.bc = left->bc + right->bc;
+	result.bd = left->bd + right->bd; result.c2 = left->c2 + right->c2;
+	result.cd = left->cd + right->cd; result.d2 = left->d2 + right->d2;
+	return result;
+}
+
+// sum of squared distances from p to every plane in the quadric
+static f64 EvaluateQuadric(Quadric *q, vec3 p)
+{
+	f64 x = p.x, y = p.y, z = p.z;
+	f64 result = q->a2 * x * x + 2.0 * q->ab * x * y + 2.0 * q->ac * x * z + 2.0 * q->ad * x +
+		q->b2 * y * y + 2.0 * q->bc * y * z + 2.0 * q->bd * y +
+		q->c2 * z * z + 2.0 * q->cd * z +
+		q->d2;
+	return max(result, 0.0);
+}
+
+static int CompareCollapses(const void *left, const void *right)
+{
+	f64 a = ((Collapse *)left)->cost;
+	f64 b = ((Collapse *)right)->cost;
+	return (a > b) - (a < b);
+}
+
+static int CompareEdges(const void *left, const void *right)
+{
+	u64 a = *(u64 *)left;
+	u64 b = *(u64 *)right;
+	return (a > b) - (a < b);
+}
+
+static u64 EdgeKey(s32 a, s32 b)
+{
+	return a < b ? ((u64)a << 32) | (u32)b : ((u64)b << 32) | (u32)a;
+}
+
+static b32 FlipsAfterMove(vec3 *positions, s32 *triangle, s32 from, vec3 to)
+{
+	vec3 before[3], after[3];
+	for (s32 k = 0; k < 3; k++) {
+		before[k] = positions[triangle[k]];
+		after[k] = triangle[k] == from ? to : before[k];
+	}
+	vec3 normal_before = Vec3Cross(Vec3Minus(before[1], before[0]), Vec3Minus(before[2], before[0]));
+	vec3 normal_after = Vec3Cross(Vec3Minus(after[1], after[0]), Vec3Minus(after[2], after[0]));
+	return Vec3Dot(normal_before, normal_after) <= 0.0f;
+}
+
+Model *SimplifyModel(Model *model, s32 target_faces, f32 *error, Arena *arena)
+{
+	Arena scratch;
+	CreateArena(&scratch, (size_t)model->num_faces * 512 + ARENA_COMMIT_SIZE);
+
+	IndexedMesh mesh;
+	WeldModel(&mesh, model, &scratch);
+	s32 *position_ids = WeldPositions(&mesh, &scratch);
+	s32 num_vertices = mesh.num_vertices;
+	s32 num_triangles = mesh.num_indices / 3;
+	s32 *indices = mesh.indices;
+
+	u8 *locked = PushArray(&scratch, u8, num_vertices);
+	u8 *dead = PushArray(&scratch, u8, num_triangles);
+	u8 *touched = PushArray(&scratch, u8, num_vertices);
+	s32 *counts = PushArray(&scratch, s32, num_vertices);
+	memset(locked, 0, num_vertices);
+	memset(dead, 0, num_triangles);
+	memset(counts, 0, sizeof(s32) * num_vertices);
+
+	// a position shared by several vertices sits on a uv/normal seam
+	for (s32 i = 0; i < num_vertices; i++)
+		counts[position_ids[i]]++;
+	for (s32 i = 0; i < num_vertices; i++)
+		locked[i] = counts[position_ids[i]] > 1;
+
+	// an edge used by only one triangle is a border (or a seam again)
+	size_t mark = ArenaMark(&scratch);
+	u64 *edges = PushArray(&scratch, u64, mesh.num_indices);
+	for (s32 i = 0; i < num_triangles; i++) {
+		for (s32 k = 0; k < 3; k++)
+			edges[i * 3 + k] = EdgeKey(indices[i * 3 + k], indices[i * 3 + (k + 1) % 3]);
+	}
+	qsort(edges, mesh.num_indices, sizeof(u64), CompareEdges);
+	for (s32 i = 0; i < mesh.num_indices;) {
+		s32 j = i;
+		while (j < mesh.num_indices && edges[j] == edges[i])
+			j++;
+		if (j - i == 1) {
+			locked[edges[i] >> 32] = 1;
+			locked[edges[i] & 0xFFFFFFFF] = 1;
+		}
+		i = j;
+	}
+	ArenaRestore(&scratch, mark);
+
+	Quadric *quadrics = PushArray(&scratch, Quadric, num_vertices);
+	memset(quadrics, 0, sizeof(Quadric) * num_vertices);
+	for (s32 i = 0; i < num_triangles; i++) {
+		vec3 p0 = mesh.positions[indices[i * 3 + 0]];
+		vec3 p1 = mesh.positions[indices[i * 3 + 1]];
+		vec3 p2 = mesh.positions[indices[i * 3 + 2]];
+		vec3 normal = Vec3Cross(Vec3Minus(p1, p0), Vec3Minus(p2, p0));
+		f32 length = Vec3Length(normal);
+		if (length == 0.0f)
+			continue;
+		normal = Vec3Scale(normal, 1.0f / length);
+		f64 d = -Vec3Dot(normal, p0);
+		for (s32 k = 0; k < 3; k++)
+			AddPlane(&quadrics[position_ids[indices[i * 3 + k]]], normal.x, normal.y, normal.z, d);
+	}
+
+	s32 *offsets = PushArray(&scratch, s32, num_vertices + 1);
+	s32 *adjacency = PushArray(&scratch, s32, mesh.num_indices);
+	Collapse *collapses = PushArray(&scratch, Collapse, mesh.num_indices * 2);
+	s32 num_live = num_triangles;
+	f64 max_cost = 0.0;
+
+	// each pass collapses the cheapest edges whose neighbourhoods don't
+	// overlap, then rebuilds adjacency for the next pass
+	while (num_live > target_faces) {
+		memset(counts, 0, sizeof(s32) * num_vertices);
+		for (s32 i = 0; i < num_triangles; i++) {
+			if (dead[i])
+				continue;
+			for (s32 k = 0; k < 3; k++)
+				counts[indices[i * 3 + k]]++;
+		}
+		offsets[0] = 0;
+		for (s32 i = 0; i < num_vertices; i++)
+			offsets[i + 1] = offsets[i] + counts[i];
+		for (s32 i = 0; i < num_triangles; i++) {
+			if (dead[i])
+				continue;
+			for (s32 k = 0; k < 3; k++) {
+				s32 vertex = indices[i * 3 + k];
+				adjacency[offsets[vertex + 1] - counts[vertex]--] = i;
+			}
+		}
+
+		// half-edge collapses move from onto to, so no new positions or
+		// uvs are invented and locked vertices never move
+		s32 num_collapses = 0;
+		for (s32 i = 0; i < num_triangles; i++) {
+			if (dead[i])
+				continue;
+			for (s32 k = 0; k < 3; k++) {
+				s32 a = indices[i * 3 + k];
+				s32 b = indices[i * 3 + (k + 1) % 3];
+				Quadric q = AddQuadrics(&quadrics[position_ids[a]], &quadrics[position_ids[b]]);
+				if (!locked[a]) {
+					collapses[num_collapses].cost = EvaluateQuadric(&q, mesh.positions[b]);
+					collapses[num_collapses].from = a;
+					collapses[num_collapses++].to = b;
+				}
+				if (!locked[b]) {
+					collapses[num_collapses].cost = EvaluateQuadric(&q, mesh.positions[a]);
+					collapses[num_collapses].from = b;
+					collapses[num_collapses++].to = a;
+				}
+			}
+		}
+		if (num_collapses == 0)
+			break;
+		qsort(collapses, num_collapses, sizeof(Collapse), CompareCollapses);
+
+		memset(touched, 0, num_vertices);
+		s32 applied = 0;
+		for (s32 i = 0; i < num_collapses && num_live > target_faces; i++) {
+			s32 from = collapses[i].from;
+			s32 to = collapses[i].to;
+			if (touched[from] || touched[to])
+				continue;
+
+			b32 flips = false;
+			for (s32 j = offsets[from]; j < offsets[from + 1] && !flips; j++) {
+				s32 *triangle = &indices[adjacency[j] * 3];
+				if (triangle[0] != to && triangle[1] != to && triangle[2] != to)
+					flips = FlipsAfterMove(mesh.positions, triangle, from, mesh.positions[to]);
+			}
+			if (flips)
+				continue;
+
+			for (s32 j = offsets[from]; j < offsets[from + 1]; j++) {
+				s32 *triangle = &indices[adjacency[j] * 3];
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+					dead[adjacency[j]] = 1;
+					num_live--;
+				} else {
+					for (s32 k = 0; k < 3; k++) {
+						if (triangle[k] == from)
+							triangle[k] = to;
+					}
+				}
+				for (s32 k = 0; k < 3; k++)
+					touched[triangle[k]] = 1;
+			}
+			touched[from] = touched[to] = 1;
+
+			quadrics[position_ids[to]] = AddQuadrics(&quadrics[position_ids[to]], &quadrics[position_ids[from]]);
+			max_cost = max(max_cost, collapses[i].cost);
+			applied++;
+		}
+		if (applied == 0)
+			break;
+	}
+
+	s32 num_indices = 0;
+	for (s32 i = 0; i < num_triangles; i++) {
+		if (dead[i])
+			continue;
+		for (s32 k = 0; k < 3; k++)
+			indices[num_indices++] = indices[i * 3 + k];
+	}
+	mesh.num_indices = num_indices;
+
+	Model *result = UnweldModel(&mesh, arena);
+	*error = (f32)sqrt(max_cost);
+
+	FreeArena(&scratch);
+	return result;
+}
+
+void GenerateLODs(ModelLODs *lods, Model *model, s32 max_levels, Arena *arena)
+{
+	memset(lods, 0, sizeof(ModelLODs));
+	lods->levels[0] = model;
+	lods->num_levels = 1;
+
+	max_levels = min(max_levels, MAX_LODS);
+	while (lods->num_levels < max_levels) {
+		Model *previous = lods->levels[lods->num_levels - 1];
+		if (previous->num_faces < 32)
+			break;
+
+		f32 error;
+		Model *level = SimplifyModel(previous, previous->num_faces / 2, &error, arena);
+
+		// locked seams can stall the reduction, another level wouldn't pay
+		if (level->num_faces > previous->num_faces * 9 / 10) {
+			FreeModel(level);
+			break;
+		}
+
+		lods->errors[lods->num_levels] = lods->errors[lods->num_levels - 1] + error;
+		lods->levels[lods->num_levels++] = level;
+	}
+}
+
+void FreeLODs(ModelLODs *lods)
+{
+	for (s32 i = 1; i < lods->num_levels; i++)
+		FreeModel(lods->levels[i]);
+	lods->num_levels = 1;
+}
+
+s32 SelectLOD(ModelLODs *lods, f32 projected_radius, f32 max_pixel_error)
+{
+	f32 pixels_per_unit = projected_radius / max(lods->levels[0]->radius, 1e-6f);
+	s32 level = 0;
+	while (level + 1 < lods->num_levels && lods->errors[level + 1] * pixels_per_unit <= max_pixel_error)
+		level++;
+	return level;
+}
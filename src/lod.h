@@ -0,0 +1,27 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "types.h"
+#include "maths.h"
+
+#include "arena.h"
+#include "model.h"
+
+#define MAX_LODS 8
+
+// levels[0] is the source model, each following level has about half the faces
+typedef struct ModelLODs {
+	Model *levels[MAX_LODS];
+	f32 errors[MAX_LODS]; // model space distance from level 0
+	s32 num_levels;
+} ModelLODs;
+
+// quadric error edge collapse; uv seams and open borders are kept intact
+Model *SimplifyModel(Model *model, s32 target_faces, f32 *error, Arena *arena);
+void GenerateLODs(ModelLODs *lods, Model *model, s32 max_levels, Arena *arena);
+void FreeLODs(ModelLODs *lods);
+
+// coarsest level whose error stays under max_pixel_error on screen
+s32 SelectLOD(ModelLODs *lods, f32 projected_radius, f32 max_pixel_error);
+
+#endif
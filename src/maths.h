@@ -372,6 +372,64 @@ inline mat4 Projection(f32 coeff)
 	return result;
 }
 
+inline mat4 Translate(vec3 offset)
+{
+	mat4 result = Mat4(1.0f);
+	result.elements[0][3] = offset.x;
+	result.elements[1][3] = offset.y;
+	result.elements[2][3] = offset.z;
+	return result;
+}
+
+inline mat4 Scale(f32 scale)
+{
+	mat4 result = Mat4(scale);
+	result.elements[3][3] = 1.0f;
+	return result;
+}
+
+inline mat4 RotateY(f32 angle)
+{
+	mat4 result = Mat4(1.0f);
+	f32 c = (f32)cos(angle);
+	f32 s = (f32)sin(angle);
+	result.elements[0][0] = c;
+	result.elements[0][2] = s;
+	result.elements[2][0] = -s;
+	result.elements[2][2] = c;
+	return result;
+}
+
+// planes are taken from the rows of the clip matrix (w +/- x, w +/- y, w > 0)
+inline b32 SphereInFrustum(mat4 mvp, vec3 centre, f32 radius)
+{
+	f32 *w = mvp.elements[3];
+	for (s32 i = 0; i < 5; i++) {
+		f32 plane[4];
+		for (s32 j = 0; j < 4; j++) {
+			f32 row = i < 4 ? mvp.elements[i >> 1][j] : 0.0f;
+			plane[j] = w[j] + ((i & 1) ? -row : row);
+		}
+		f32 length = (f32)sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		f32 distance = plane[0] * centre.x + plane[1] * centre.y + plane[2] * centre.z + plane[3];
+		if (distance < -radius * length)
+			return 0;
+	}
+	return 1;
+}
+
+// approximate radius in pixels of a bounding sphere after projection
+inline f32 ProjectedRadius(mat4 mvp, vec3 centre, f32 radius, s32 viewport_width)
+{
+	f32 *x = mvp.elements[0];
+	f32 *w = mvp.elements[3];
+	f32 clip_w = w[0] * centre.x + w[1] * centre.y + w[2] * centre.z + w[3];
+	if (clip_w <= 1e-6f)
+		return (f32)viewport_width;
+	f32 scale = (f32)sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+	return radius * scale / clip_w * viewport_width * 0.5f;
+}
+
 inline mat4 Mat4Inverse(mat4 m)
 {
 	f32 coef00 = m.elements[2][2] * m.elements[3][3] - m.elements[3][2] * m.elements[2][3];
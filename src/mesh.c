@@ -0,0 +1,121 @@
+#include "mesh.h"
+
+static u32 HashFloats(f32 *values, s32 count)
+{
+	u32 hash = 2166136261u;
+	for (s32 i = 0; i < count; i++) {
+		u32 bits;
+		memcpy(&bits, &values[i], sizeof(bits));
+		hash = (hash ^ bits) * 16777619u;
+	}
+	return hash ^ (hash >> 15);
+}
+
+static s32 TableSize(s32 count)
+{
+	s32 size = 1;
+	while (size < count * 2)
+		size <<= 1;
+	return size;
+}
+
+// packs the attributes compared for welding, vec2 carries unused fields
+static void VertexKey(f32 key[8], vec3 position, vec2 texcoord, vec3 normal)
+{
+	key[0] = position.x;
+	key[1] = position.y;
+	key[2] = position.z;
+	key[3] = texcoord.x;
+	key[4] = texcoord.y;
+	key[5] = normal.x;
+	key[6] = normal.y;
+	key[7] = normal.z;
+}
+
+void WeldModel(IndexedMesh *mesh, Model *model, Arena *arena)
+{
+	s32 num_corners = model->num_faces * 3;
+	s32 table_size = TableSize(num_corners);
+	s32 num_vertices = 0;
+
+	s32 *indices = PushArray(arena, s32, num_corners);
+
+	// the table is dropped before the vertex arrays are pushed over it
+	size_t mark = ArenaMark(arena);
+	s32 *table = PushArray(arena, s32, table_size);
+	memset(table, 0xFF, sizeof(s32) * table_size);
+
+	for (s32 i = 0; i < num_corners; i++) {
+		f32 key[8];
+		VertexKey(key, model->positions[i], model->texcoords[i], model->normals[i]);
+
+		u32 slot = HashFloats(key, 8) & (table_size - 1);
+		while (table[slot] >= 0) {
+			f32 other[8];
+			s32 j = table[slot];
+			VertexKey(other, model->positions[j], model->texcoords[j], model->normals[j]);
+			if (memcmp(key, other, sizeof(key)) == 0)
+				break;
+			slot = (slot + 1) & (table_size - 1);
+		}
+
+		if (table[slot] < 0) {
+			table[slot] = i;
+			indices[i] = num_vertices++;
+		} else {
+			indices[i] = indices[table[slot]];
+		}
+	}
+	ArenaRestore(arena, mark);
+
+	mesh->positions = PushArray(arena, vec3, num_vertices);
+	mesh->texcoords = PushArray(arena, vec2, num_vertices);
+	mesh->normals = PushArray(arena, vec3, num_vertices);
+	mesh->indices = indices;
+	mesh->num_vertices = num_vertices;
+	mesh->num_indices = num_corners;
+
+	for (s32 i = 0; i < num_corners; i++) {
+		mesh->positions[indices[i]] = model->positions[i];
+		mesh->texcoords[indices[i]] = model->texcoords[i];
+		mesh->normals[indices[i]] = model->normals[i];
+	}
+}
+
+Model *UnweldModel(IndexedMesh *mesh, Arena *arena)
+{
+	Model *model = AllocateModel(mesh->num_indices / 3, arena);
+
+	for (s32 i = 0; i < mesh->num_indices; i++) {
+		s32 index = mesh->indices[i];
+		model->positions[i] = mesh->positions[index];
+		model->texcoords[i] = mesh->texcoords[index];
+		model->normals[i] = mesh->normals[index];
+	}
+	ComputeBounds(model);
+
+	return model;
+}
+
+s32 *WeldPositions(IndexedMesh *mesh, Arena *arena)
+{
+	s32 table_size = TableSize(mesh->num_vertices);
+	s32 *position_ids = PushArray(arena, s32, mesh->num_vertices);
+	size_t mark = ArenaMark(arena);
+	s32 *table = PushArray(arena, s32, table_size);
+	memset(table, 0xFF, sizeof(s32) * table_size);
+
+	for (s32 i = 0; i < mesh->num_vertices; i++) {
+		vec3 position = mesh->positions[i];
+		u32 slot = HashFloats(position.elements, 3) & (table_size - 1);
+		while (table[slot] >= 0 && memcmp(&mesh->positions[table[slot]], &position, sizeof(vec3)) != 0)
+			slot = (slot + 1) & (table_size - 1);
+
+		if (table[slot] < 0)
+			table[slot] = i;
+		position_ids[i] = table[slot];
+	}
+	ArenaRestore(arena, mark);
+
+	return position_ids;
+}
@@ -0,0 +1,29 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include "types.h"
+#include "maths.h"
+
+#include "arena.h"
+#include "model.h"
+
+// Model stores three unshared corners per face, processing passes want
+// shared vertices; a vertex is a unique (position, texcoord, normal)
+typedef struct IndexedMesh {
+	vec3 *positions;
+	vec2 *texcoords;
+	vec3 *normals;
+	s32 num_vertices;
+
+	s32 *indices;
+	s32 num_indices;
+} IndexedMesh;
+
+void WeldModel(IndexedMesh *mesh, Model *model, Arena *arena);
+Model *UnweldModel(IndexedMesh *mesh, Arena *arena);
+
+// maps every vertex to one representative of its position, so vertices
+// split by a uv or normal seam share an id
+s32 *WeldPositions(IndexedMesh *mesh, Arena *arena);
+
+#endif
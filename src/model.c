@@ -2,102 +2,289 @@
 
 #pragma warning(disable : 4996)
 
-static char* ReadLine(FILE* file)
+static volatile LONG model_generation;
+
+Model *AllocateModel(s32 num_faces, Arena *arena)
 {
-    char* line = NULL;
+    s32 num_indices = num_faces * 3;
 
-    while (1) {
-        s32 c = fgetc(file);
-        if (c == EOF)
-            return NULL;
-        sb_push(line, (char)c);
-        if (c == '\n') {
-            sb_push(line, '\0');
-            return line;
+    // header and vertex streams share one allocation
+    size_t header_size = (sizeof(Model) + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    size_t positions_size = sizeof(vec3) * num_indices;
+    size_t texcoords_size = sizeof(vec2) * num_indices;
+    size_t normals_size = sizeof(vec3) * num_indices;
+    size_t size = header_size + positions_size + texcoords_size + normals_size;
+    u8 *memory = arena ? (u8 *)ArenaPushZero(arena, size) : (u8 *)calloc(1, size);
+
+    Model *model = (Model *)memory;
+    model->positions = (vec3 *)(memory + header_size);
+    model->texcoords = (vec2 *)(memory + header_size + positions_size);
+    model->normals = (vec3 *)(memory + header_size + positions_size + texcoords_size);
+    model->num_faces = num_faces;
+    model->in_arena = arena != NULL;
+    TouchModel(model);
+
+    return model;
+}
+
+void ComputeBounds(Model *model)
+{
+    s32 num_indices = model->num_faces * 3;
+    vec3 *positions = model->positions;
+
+    if (num_indices == 0) {
+        model->centre = Vec3f(0.0f, 0.0f, 0.0f);
+        model->radius = 0.0f;
+        return;
+    }
+
+    vec3 lower = positions[0];
+    vec3 upper = positions[0];
+    for (s32 i = 1; i < num_indices; i++) {
+        lower = Vec3f(min(lower.x, positions[i].x), min(lower.y, positions[i].y), min(lower.z, positions[i].z));
+        upper = Vec3f(max(upper.x, positions[i].x), max(upper.y, positions[i].y), max(upper.z, positions[i].z));
+    }
+    model->centre = Vec3Scale(Vec3Add(lower, upper), 0.5f);
+    model->radius = 0.0f;
+    for (s32 i = 0; i < num_indices; i++)
+        model->radius = max(model->radius, Vec3Length(Vec3Minus(positions[i], model->centre)));
+}
+
+typedef struct ObjChunk {
+    char *start;
+    char *end;
+
+    // records in the chunk, then where they land in the merged arrays
+    s32 num_positions, num_texcoords, num_normals, num_faces;
+    s32 first_position, first_texcoord, first_normal, first_face;
+    b32 failed; // a malformed record, the whole load fails
+} ObjChunk;
+
+typedef struct ObjParse {
+    ObjChunk *chunks;
+    vec3 *positions;
+    vec2 *texcoords;
+    vec3 *normals;
+    s32 *indices;
+    s32 num_positions, num_texcoords, num_normals;
+    Model *model;
+} ObjParse;
+
+static void RunRange(JobSystem *jobs, s32 count, s32 grain, RangeFunc func, void *data)
+{
+    if (jobs)
+        ParallelFor(jobs, count, grain, func, data);
+    else
+        func(data, 0, count, -1);
+}
+
+// first pass: terminate lines and count records, so every array is
+// allocated once at its final size
+static void CountChunks(void *data, s32 start, s32 end, s32 worker)
+{
+    ObjParse *parse = (ObjParse *)data;
+
+    for (s32 i = start; i < end; i++) {
+        ObjChunk *chunk = &parse->chunks[i];
+        for (char *line = chunk->start; line < chunk->end; line += strlen(line) + 1) {
+            char *newline = (char *)memchr(line, '\n', chunk->end - line);
+            if (newline)
+                *newline = '\0';
+
+            if (strncmp(line, "v ", 2) == 0)
+                chunk->num_positions++;
+            else if (strncmp(line, "vt ", 3) == 0)
+                chunk->num_texcoords++;
+            else if (strncmp(line, "vn ", 3) == 0)
+                chunk->num_normals++;
+            else if (strncmp(line, "f ", 2) == 0)
+                chunk->num_faces++;
         }
     }
 }
 
-Model *LoadModel(const char* file_name)
+// false if no number starts at the cursor
+static b32 ParseFloat(char **cursor, f32 *value)
 {
-    Model *model;
-    FILE *file;
+    char *start = *cursor;
+    *value = strtof(start, cursor);
+    return *cursor != start;
+}
 
-    vec3 *positions = NULL;
-    vec2 *texcoords = NULL;
-    vec3 *normals = NULL;
-    s32 *position_index = NULL;
-    s32 *texcoord_index = NULL;
-    s32 *normal_index = NULL;
+// one v/vt/vn index made zero based; negative indices count back from
+// the last record read before the face, count. false for a missing or
+// out of range index
+static b32 ParseIndex(char **cursor, s32 count, s32 total, s32 *index)
+{
+    char *start = *cursor;
+    s32 value = (s32)strtol(start, cursor, 10);
+    if (*cursor == start)
+        return false;
+    if (**cursor == '/')
+        (*cursor)++;
 
-    file = fopen(file_name, "rb");
-    assert(file != NULL);
-    while (1) {
-        char* line = ReadLine(file);
-        if (line == NULL)
-            break;
-
-        if (strncmp(line, "v ", 2) == 0) { // positions
-            vec3 position;
-            s32 items = sscanf(line + 2, "%f %f %f", &position.x, &position.y, &position.z);
-            assert(items == 3);
-            sb_push(positions, position);
-        } else if (strncmp(line, "vt ", 3) == 0) { // texcoords
-            vec2 texcoord;
-            s32 items = sscanf(line + 3, "%f %f", &texcoord.x, &texcoord.y);
-            assert(items == 2);
-            sb_push(texcoords, texcoord);
-        } else if (strncmp(line, "vn ", 3) == 0) { // normals
-            vec3 normal;
-            s32 items = sscanf(line + 3, "%f %f %f", &normal.x, &normal.y, &normal.z);
-            assert(items == 3);
-            sb_push(normals, normal);
-        } else if (strncmp(line, "f ", 2) == 0) { // faces
-            s32 position[3], texcoord[3], normal[3];
-            s32 items = sscanf(line + 2, "%d/%d/%d %d/%d/%d %d/%d/%d",
-                &position[0], &texcoord[0], &normal[0],
-                &position[1], &texcoord[1], &normal[1],
-                &position[2], &texcoord[2], &normal[2]
-            );
-            assert(items == 9);
-            for (s32 i = 0; i < 3; i++) {
-                sb_push(position_index, position[i] - 1);
-                sb_push(texcoord_index, texcoord[i] - 1);
-                sb_push(normal_index, normal[i] - 1);
+    *index = value < 0 ? count + value : value - 1;
+    return *index >= 0 && *index < total;
+}
+
+// second pass: parse records into the merged arrays, faces resolve their
+// indices against the counts summed over the chunks before
+static void ParseChunks(void *data, s32 start, s32 end, s32 worker)
+{
+    ObjParse *parse = (ObjParse *)data;
+
+    for (s32 i = start; i < end; i++) {
+        ObjChunk *chunk = &parse->chunks[i];
+        s32 num_positions = chunk->first_position;
+        s32 num_texcoords = chunk->first_texcoord;
+        s32 num_normals = chunk->first_normal;
+        s32 num_faces = chunk->first_face;
+
+        b32 ok = true;
+        for (char *line = chunk->start; ok && line < chunk->end; line += strlen(line) + 1) {
+            if (strncmp(line, "v ", 2) == 0) { // positions
+                vec3 *position = &parse->positions[num_positions++];
+                char *cursor = line + 2;
+                ok = ParseFloat(&cursor, &position->x) && ParseFloat(&cursor, &position->y) &&
+                    ParseFloat(&cursor, &position->z);
+            } else if (strncmp(line, "vt ", 3) == 0) { // texcoords
+                vec2 *texcoord = &parse->texcoords[num_texcoords++];
+                char *cursor = line + 3;
+                ok = ParseFloat(&cursor, &texcoord->x) && ParseFloat(&cursor, &texcoord->y);
+            } else if (strncmp(line, "vn ", 3) == 0) { // normals
+                vec3 *normal = &parse->normals[num_normals++];
+                char *cursor = line + 3;
+                ok = ParseFloat(&cursor, &normal->x) && ParseFloat(&cursor, &normal->y) &&
+                    ParseFloat(&cursor, &normal->z);
+            } else if (strncmp(line, "f ", 2) == 0) { // faces, v/vt/vn triangles
+                s32 *face = &parse->indices[num_faces++ * 9];
+                char *cursor = line + 2;
+                for (s32 corner = 0; ok && corner < 3; corner++) {
+                    ok = ParseIndex(&cursor, num_positions, parse->num_positions, &face[corner * 3 + 0]) &&
+                        ParseIndex(&cursor, num_texcoords, parse->num_texcoords, &face[corner * 3 + 1]) &&
+                        ParseIndex(&cursor, num_normals, parse->num_normals, &face[corner * 3 + 2]);
+                }
             }
         }
-        sb_free(line);
+        chunk->failed = !ok;
     }
+}
+
+static void ExpandFaces(void *data, s32 start, s32 end, s32 worker)
+{
+    ObjParse *parse = (ObjParse *)data;
+    Model *model = parse->model;
+    s32 *indices = parse->indices;
+
+    for (s32 i = start; i < end; i++) {
+        model->positions[i] = parse->positions[indices[i * 3 + 0]];
+        model->texcoords[i] = parse->texcoords[indices[i * 3 + 1]];
+        model->normals[i] = parse->normals[indices[i * 3 + 2]];
+    }
+}
+
+Model *LoadModel(const char* file_name, Arena *arena)
+{
+    return LoadModelParallel(NULL, file_name, arena);
+}
+
+Model *LoadModelParallel(JobSystem *jobs, const char *file_name, Arena *arena)
+{
+    FILE *file;
+    Arena scratch;
+    ObjParse parse;
+
+    file = fopen(file_name, "rb");
+    if (file == NULL)
+        return NULL;
+    _fseeki64(file, 0, SEEK_END);
+    s64 file_size = _ftelli64(file);
+    _fseeki64(file, 0, SEEK_SET);
+    if (file_size < 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    // parsed records never take more than twice the text they came from
+    CreateArena(&scratch, (size_t)file_size * 4 + ARENA_COMMIT_SIZE);
+    char *text = PushArray(&scratch, char, file_size + 1);
+    size_t bytes_read = fread(text, 1, (size_t)file_size, file);
     fclose(file);
+    if (bytes_read != (size_t)file_size) {
+        FreeArena(&scratch);
+        return NULL;
+    }
+    text[file_size] = '\0';
 
-    s32 num_indices = sb_count(position_index);
+    // chunks end just past a newline so no line is split between two
+    s32 num_chunks = (s32)(file_size / OBJ_CHUNK_SIZE) + 1;
+    parse.chunks = PushArray(&scratch, ObjChunk, num_chunks);
+    memset(parse.chunks, 0, sizeof(ObjChunk) * num_chunks);
+    char *end = text + file_size;
+    char *chunk_start = text;
+    for (s32 i = 0; i < num_chunks; i++) {
+        char *chunk_end = end;
+        if (i < num_chunks - 1 && chunk_start + OBJ_CHUNK_SIZE < end) {
+            char *newline = (char *)memchr(chunk_start + OBJ_CHUNK_SIZE, '\n', end - (chunk_start + OBJ_CHUNK_SIZE));
+            chunk_end = newline ? newline + 1 : end;
+        }
+        parse.chunks[i].start = chunk_start;
+        parse.chunks[i].end = chunk_end;
+        chunk_start = chunk_end;
+    }
 
-    model = (Model*)malloc(sizeof(Model));
-    model->positions = (vec3*)malloc(sizeof(vec3) * num_indices);
-    model->texcoords = (vec2*)malloc(sizeof(vec2) * num_indices);
-    model->normals = (vec3*)malloc(sizeof(vec3) * num_indices);
-    model->num_faces = sb_count(position_index) / 3;
+    RunRange(jobs, num_chunks, 1, CountChunks, &parse);
 
-    for (s32 i = 0; i < num_indices; i++) {
-        model->positions[i] = positions[position_index[i]];
-        model->texcoords[i] = texcoords[texcoord_index[i]];
-        model->normals[i] = normals[normal_index[i]];
+    s32 num_positions = 0, num_texcoords = 0, num_normals = 0, num_faces = 0;
+    for (s32 i = 0; i < num_chunks; i++) {
+        ObjChunk *chunk = &parse.chunks[i];
+        chunk->first_position = num_positions;
+        chunk->first_texcoord = num_texcoords;
+        chunk->first_normal = num_normals;
+        chunk->first_face = num_faces;
+        num_positions += chunk->num_positions;
+        num_texcoords += chunk->num_texcoords;
+        num_normals += chunk->num_normals;
+        num_faces += chunk->num_faces;
     }
 
-    sb_free(positions);
-    sb_free(texcoords);
-    sb_free(normals);
-    sb_free(position_index);
-    sb_free(texcoord_index);
-    sb_free(normal_index);
+    parse.positions = PushArray(&scratch, vec3, num_positions);
+    parse.texcoords = PushArray(&scratch, vec2, num_texcoords);
+    parse.normals = PushArray(&scratch, vec3, num_normals);
+    parse.indices = PushArray(&scratch, s32, num_faces * 9);
+    parse.num_positions = num_positions;
+    parse.num_texcoords = num_texcoords;
+    parse.num_normals = num_normals;
 
-    return model;
+    RunRange(jobs, num_chunks, 1, ParseChunks, &parse);
+
+    // a bad number or index fails the load before anything is allocated
+    // from the caller's arena
+    for (s32 i = 0; i < num_chunks; i++) {
+        if (parse.chunks[i].failed) {
+            FreeArena(&scratch);
+            return NULL;
+        }
+    }
+
+    parse.model = AllocateModel(num_faces, arena);
+    RunRange(jobs, num_faces * 3, 0, ExpandFaces, &parse);
+
+    ComputeBounds(parse.model);
+
+    FreeArena(&scratch);
+
+    return parse.model;
 }
 
 void FreeModel(Model* model)
 {
-    free(model->positions);
-    free(model->texcoords);
-    free(model->normals);
-    free(model);
-}
\ No newline at end of file
+    if (model && !model->in_arena)
+        free(model);
+}
+
+void TouchModel(Model *model)
+{
+    // as with images, a freed model's address can come back for the next
+    model->generation = (u32)InterlockedIncrement(&model_generation);
+}
@@ -9,16 +9,36 @@
 #include "types.h"
 #include "maths.h"
 
-#include "stretchy_buffer.h"
+#include "arena.h"
+#include "jobs.h"
+
+#define OBJ_CHUNK_SIZE (1024 * 1024) // bytes of text per parse job
 
 typedef struct Model {
 	vec3 *positions;
 	vec2 *texcoords;
 	vec3 *normals;
 	s32 num_faces;
+
+	// bounding sphere in model space
+	vec3 centre;
+	f32 radius;
+
+	b32 in_arena;
+	u32 generation; // unique per allocation or change, what derived caches key on
 } Model;
 
-Model *LoadModel(const char *file_name);
+// with a NULL arena the model is a single malloc block released by FreeModel
+Model *AllocateModel(s32 num_faces, Arena *arena);
+// NULL if the file can't be read or a record is malformed, faces must be
+// v/vt/vn triangles with indices in range
+Model *LoadModel(const char *file_name, Arena *arena);
+// parses chunks of the file on the job system, same result as LoadModel
+Model *LoadModelParallel(JobSystem *jobs, const char *file_name, Arena *arena);
+void ComputeBounds(Model *model);
 void FreeModel(Model *model);
+// gives the model a new generation; call after changing it in place, and
+// only between frames
+void TouchModel(Model *model);
 
 #endif
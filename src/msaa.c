@@ -0,0 +1,51 @@
+#include "msaa.h"
+
+void CreateMultisampleBuffer(MultisampleBuffer *buffer, s32 width, s32 height, Arena *arena)
+{
+	s64 num_pixels = (s64)width * height;
+	size_t needed = (size_t)num_pixels * MSAA_BYTES_PER_PIXEL + 4 * ARENA_ALIGNMENT;
+	assert(arena->reserved - arena->used >= needed && "multisample buffer does not fit, the arena needs MSAA_BYTES_PER_PIXEL per pixel free");
+
+	buffer->width = width;
+	buffer->height = height;
+	buffer->depth = PushArray(arena, f32, num_pixels * MSAA_SAMPLES);
+	buffer->colour = PushArray(arena, u32, num_pixels);
+	buffer->split = PushArray(arena, u8, num_pixels);
+	buffer->sample_colour = PushArray(arena, u32, num_pixels * (MSAA_SAMPLES - 1));
+	buffer->num_splits = 0;
+}
+
+void ClearMultisampleBuffer(MultisampleBuffer *buffer)
+{
+	// sample colour is only read once a pixel splits, which fills it first
+	s64 num_pixels = (s64)buffer->width * buffer->height;
+	memset(buffer->depth, 0, sizeof(f32) * num_pixels * MSAA_SAMPLES);
+	memset(buffer->colour, 0, sizeof(u32) * num_pixels);
+	memset(buffer->split, 0, num_pixels);
+	buffer->num_splits = 0;
+}
+
+void ResolveMultisampleBuffer(MultisampleBuffer *buffer, Backbuffer *output)
+{
+	s64 num_pixels = (s64)buffer->width * buffer->height;
+	u32 *pixels = (u32 *)output->memory;
+
+	assert(output->width == buffer->width && output->height == buffer->height);
+
+	for (s64 i = 0; i < num_pixels; i++) {
+		if (!buffer->split[i]) {
+			pixels[i] = buffer->colour[i];
+			continue;
+		}
+
+		// the channels are summed in place, four 8 bit values fit in 10 bits
+		u32 *samples = &buffer->sample_colour[i * (MSAA_SAMPLES - 1)];
+		u32 rb = buffer->colour[i] & 0xFF00FF;
+		u32 g = buffer->colour[i] & 0x00FF00;
+		for (s32 k = 0; k < MSAA_SAMPLES - 1; k++) {
+			rb += samples[k] & 0xFF00FF;
+			g += samples[k] & 0x00FF00;
+		}
+		pixels[i] = ((rb + 0x020002) >> 2 & 0xFF00FF) | ((g + 0x000200) >> 2 & 0x00FF00);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef MSAA_H
+#define MSAA_H
+
+#include <string.h>
+#include <assert.h>
+
+#include "types.h"
+
+#include "arena.h"
+#include "backbuffer.h"
+
+#define MSAA_SAMPLES 4
+#define MSAA_BYTES_PER_PIXEL (MSAA_SAMPLES * sizeof(f32) + sizeof(u32) + sizeof(u8) + (MSAA_SAMPLES - 1) * sizeof(u32))
+
+// 4x multisampled colour and depth. depth is kept per sample; colour is
+// one value per pixel until a triangle covers only some of its samples,
+// only then are samples 1-3 stored, so interior pixels cost one write
+typedef struct MultisampleBuffer {
+	s32 width;
+	s32 height;
+
+	f32 *depth;         // MSAA_SAMPLES per pixel
+	u32 *colour;        // sample 0, the whole pixel unless split
+	u8 *split;
+	u32 *sample_colour; // samples 1-3 of split pixels, 3 per pixel
+
+	s64 num_splits; // stats, pixels that needed per sample colour
+} MultisampleBuffer;
+
+// storage comes from the arena, the backbuffer's frame scratch reserves
+// enough for its own size
+void CreateMultisampleBuffer(MultisampleBuffer *buffer, s32 width, s32 height, Arena *arena);
+void ClearMultisampleBuffer(MultisampleBuffer *buffer);
+// box filter of the samples into output, which has the same size
+void ResolveMultisampleBuffer(MultisampleBuffer *buffer, Backbuffer *output);
+
+#endif
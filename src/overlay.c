@@ -0,0 +1,197 @@
+#include "overlay.h"
+#include "draw.h"
+#include "mesh.h"
+
+#define POINT_INSIDE 0
+#define POINT_OUTSIDE 1
+#define POINT_BEHIND 2
+
+typedef struct ProjectedPoint {
+	vec2 point;
+	s32 state;
+} ProjectedPoint;
+
+static int CompareEdges(const void *left, const void *right)
+{
+	u64 a = *(u64 *)left;
+	u64 b = *(u64 *)right;
+	return (a > b) - (a < b);
+}
+
+static u64 EdgeKey(s32 a, s32 b)
+{
+	return a < b ? ((u64)a << 32) | (u32)b : ((u64)b << 32) | (u32)a;
+}
+
+void BuildWireMesh(WireMesh *wire, Model *model, Arena *arena)
+{
+	Arena scratch;
+	s32 num_corners = model->num_faces * 3;
+	CreateArena(&scratch, (size_t)num_corners * 32 + ARENA_COMMIT_SIZE);
+
+	// every corner as its own vertex, welding then only merges positions
+	IndexedMesh corners;
+	corners.positions = model->positions;
+	corners.num_vertices = num_corners;
+	s32 *position_ids = WeldPositions(&corners, &scratch);
+
+	s32 *remap = PushArray(&scratch, s32, num_corners);
+	s32 num_positions = 0;
+	for (s32 i = 0; i < num_corners; i++)
+		remap[i] = position_ids[i] == i ? num_positions++ : remap[position_ids[i]];
+
+	wire->positions = PushArray(arena, vec3, num_positions);
+	wire->num_positions = num_positions;
+	wire->lower = wire->upper = num_corners ? model->positions[0] : Vec3f(0.0f, 0.0f, 0.0f);
+	for (s32 i = 0; i < num_corners; i++) {
+		vec3 position = model->positions[i];
+		wire->positions[remap[i]] = position;
+		wire->lower = Vec3f(min(wire->lower.x, position.x), min(wire->lower.y, position.y), min(wire->lower.z, position.z));
+		wire->upper = Vec3f(max(wire->upper.x, position.x), max(wire->upper.y, position.y), max(wire->upper.z, position.z));
+	}
+
+	u64 *edges = PushArray(&scratch, u64, num_corners);
+	for (s32 i = 0; i < model->num_faces; i++) {
+		for (s32 k = 0; k < 3; k++)
+			edges[i * 3 + k] = EdgeKey(remap[i * 3 + k], remap[i * 3 + (k + 1) % 3]);
+	}
+	qsort(edges, num_corners, sizeof(u64), CompareEdges);
+
+	s32 num_edges = 0;
+	for (s32 i = 0; i < num_corners; i++) {
+		if (i == 0 || edges[i] != edges[i - 1])
+			edges[num_edges++] = edges[i];
+	}
+
+	wire->edges = PushArray(arena, s32, num_edges * 2);
+	wire->num_edges = num_edges;
+	for (s32 i = 0; i < num_edges; i++) {
+		wire->edges[i * 2 + 0] = (s32)(edges[i] >> 32);
+		wire->edges[i * 2 + 1] = (s32)(edges[i] & 0xFFFFFFFF);
+	}
+
+	FreeArena(&scratch);
+}
+
+void BeginLineBatch(LineBatch *batch, Backbuffer *buffer, Arena *arena, s32 max_lines)
+{
+	batch->lines = PushArray(arena, OverlayLine, max_lines);
+	batch->num_lines = 0;
+	batch->max_lines = max_lines;
+	batch->buffer = buffer;
+	batch->arena = arena;
+}
+
+void PushLine(LineBatch *batch, vec2 v0, vec2 v1, u32 colour)
+{
+	Backbuffer *buffer = batch->buffer;
+	if (batch->num_lines == batch->max_lines || !ClipLine(buffer, &v0, &v1))
+		return;
+
+	// clipping non-finite ends can leave them anywhere, nan included
+	if (!(v0.x >= buffer->clip_x0 && v0.x < buffer->clip_x1 && v1.x >= buffer->clip_x0 && v1.x < buffer->clip_x1 &&
+		v0.y >= buffer->clip_y0 && v0.y < buffer->clip_y1 && v1.y >= buffer->clip_y0 && v1.y < buffer->clip_y1))
+		return;
+
+	OverlayLine *line = &batch->lines[batch->num_lines++];
+	line->x0 = (s32)v0.x;
+	line->y0 = (s32)v0.y;
+	line->x1 = (s32)v1.x;
+	line->y1 = (s32)v1.y;
+	line->colour = colour;
+}
+
+// screen position, false behind the eye
+static b32 ProjectPoint(vec3 position, mat4 mvp, mat4 viewport, vec2 *point)
+{
+	vec4 clip_coord = Mat4MultiplyVec4(mvp, Vec4(position, 1.0f));
+	if (clip_coord.w <= 0.0f)
+		return false;
+
+	vec4 coord = Vec4f(clip_coord.x / clip_coord.w, clip_coord.y / clip_coord.w, clip_coord.z / clip_coord.w, 1.0f);
+	vec4 screen_coord = Mat4MultiplyVec4(viewport, coord);
+	*point = Vec2f(screen_coord.x, screen_coord.y);
+	return true;
+}
+
+void PushWireMesh(LineBatch *batch, WireMesh *wire, mat4 mvp, mat4 viewport, u32 colour)
+{
+	Backbuffer *buffer = batch->buffer;
+	size_t mark = ArenaMark(batch->arena);
+	ProjectedPoint *points = PushArray(batch->arena, ProjectedPoint, wire->num_positions);
+
+	// the viewport is affine, so it can go before the divide and each
+	// point costs one transform
+	mat4 transform = Mat4Multiply(mvp, viewport);
+	f32 x0 = (f32)buffer->clip_x0, y0 = (f32)buffer->clip_y0;
+	f32 x1 = (f32)buffer->clip_x1, y1 = (f32)buffer->clip_y1;
+	for (s32 i = 0; i < wire->num_positions; i++) {
+		vec4 coord = Mat4MultiplyVec4(transform, Vec4(wire->positions[i], 1.0f));
+		if (coord.w <= 0.0f) {
+			points[i].state = POINT_BEHIND;
+			continue;
+		}
+		vec2 point = Vec2f(coord.x / coord.w, coord.y / coord.w);
+		points[i].point = point;
+		points[i].state = point.x >= x0 && point.x < x1 && point.y >= y0 && point.y < y1 ? POINT_INSIDE : POINT_OUTSIDE;
+	}
+
+	// most edges of a dense mesh are on screen and need no clipping
+	for (s32 i = 0; i < wire->num_edges; i++) {
+		ProjectedPoint *a = &points[wire->edges[i * 2 + 0]];
+		ProjectedPoint *b = &points[wire->edges[i * 2 + 1]];
+		if (a->state == POINT_BEHIND || b->state == POINT_BEHIND)
+			continue;
+
+		if (a->state == POINT_INSIDE && b->state == POINT_INSIDE && batch->num_lines < batch->max_lines) {
+			OverlayLine *line = &batch->lines[batch->num_lines++];
+			line->x0 = (s32)a->point.x;
+			line->y0 = (s32)a->point.y;
+			line->x1 = (s32)b->point.x;
+			line->y1 = (s32)b->point.y;
+			line->colour = colour;
+		} else {
+			PushLine(batch, a->point, b->point, colour);
+		}
+	}
+
+	// the lines were pushed before the mark, only the points are dropped
+	ArenaRestore(batch->arena, mark);
+}
+
+void PushBox(LineBatch *batch, vec3 lower, vec3 upper, mat4 mvp, mat4 viewport, u32 colour)
+{
+	vec2 points[8];
+	u8 visible[8];
+	for (s32 i = 0; i < 8; i++) {
+		vec3 corner = Vec3f(i & 1 ? upper.x : lower.x, i & 2 ? upper.y : lower.y, i & 4 ? upper.z : lower.z);
+		visible[i] = (u8)ProjectPoint(corner, mvp, viewport, &points[i]);
+	}
+
+	// corners differing in exactly one bit share an edge
+	for (s32 i = 0; i < 8; i++) {
+		for (s32 bit = 1; bit < 8; bit <<= 1) {
+			s32 j = i | bit;
+			if (j != i && visible[i] && visible[j])
+				PushLine(batch, points[i], points[j], colour);
+		}
+	}
+}
+
+void PushTileGrid(LineBatch *batch, s32 tile_size, u32 colour)
+{
+	f32 width = (f32)batch->buffer->width;
+	f32 height = (f32)batch->buffer->height;
+	for (s32 x = tile_size; x < batch->buffer->width; x += tile_size)
+		PushLine(batch, Vec2f((f32)x, 0.0f), Vec2f((f32)x, height), colour);
+	for (s32 y = tile_size; y < batch->buffer->height; y += tile_size)
+		PushLine(batch, Vec2f(0.0f, (f32)y), Vec2f(width, (f32)y), colour);
+}
+
+void DrawLineBatch(LineBatch *batch)
+{
+	for (s32 i = 0; i < batch->num_lines; i++) {
+		OverlayLine *line = &batch->lines[i];
+		DrawLine(batch->buffer, line->x0, line->y0, line->x1, line->y1, line->colour);
+	}
+}
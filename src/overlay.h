@@ -0,0 +1,54 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "types.h"
+#include "maths.h"
+
+#include "arena.h"
+#include "platform.h"
+#include "model.h"
+
+#define OVERLAY_EDGE_COLOUR 0xC0C0C0
+#define OVERLAY_BOX_COLOUR 0xFFD000
+#define OVERLAY_GRID_COLOUR 0x303030
+
+// unique edges of a model over its welded positions, so an edge shared by
+// two faces is drawn once and each position is projected once
+typedef struct WireMesh {
+	vec3 *positions;
+	s32 num_positions;
+	s32 *edges; // pairs of position indices
+	s32 num_edges;
+
+	vec3 lower, upper; // model space bounding box
+} WireMesh;
+
+void BuildWireMesh(WireMesh *wire, Model *model, Arena *arena);
+
+// screen space line, already clipped to the batch's buffer
+typedef struct OverlayLine {
+	s32 x0, y0;
+	s32 x1, y1;
+	u32 colour;
+} OverlayLine;
+
+// per-frame line list, clipped as lines are pushed and drawn in one go;
+// storage comes from an arena reset with the frame, as for DrawQueue
+typedef struct LineBatch {
+	OverlayLine *lines;
+	s32 num_lines;
+	s32 max_lines;
+
+	Backbuffer *buffer;
+	Arena *arena;
+} LineBatch;
+
+void BeginLineBatch(LineBatch *batch, Backbuffer *buffer, Arena *arena, s32 max_lines);
+void PushLine(LineBatch *batch, vec2 v0, vec2 v1, u32 colour);
+// edges with an end behind the eye are dropped rather than clipped in 3d
+void PushWireMesh(LineBatch *batch, WireMesh *wire, mat4 mvp, mat4 viewport, u32 colour);
+void PushBox(LineBatch *batch, vec3 lower, vec3 upper, mat4 mvp, mat4 viewport, u32 colour);
+void PushTileGrid(LineBatch *batch, s32 tile_size, u32 colour);
+void DrawLineBatch(LineBatch *batch);
+
+#endif
@@ -7,20 +7,15 @@
 #include "maths.h"
 
 #include "shaders.h"
-
-typedef struct Backbuffer {
-	s32 width;
-	s32 height;
-	void *memory;
-	BITMAPINFO bitmapInfo;
-	f32 *zbuffer;
-} Backbuffer;
+#include "backbuffer.h"
+#include "frames.h"
 
 typedef struct Platform {
 	b32 running;
-	Backbuffer backbuffer;
-	mat4 viewport;
-	Program program;
+	s32 width;
+	s32 height;
+	b32 repaint; // window contents were lost, present the last frame again
+	FrameRing frames;
 } Platform;
 
 // remove globals in future
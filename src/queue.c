@@ -0,0 +1,112 @@
+#include "queue.h"
+#include "scene.h"
+
+void BeginDrawQueue(DrawQueue *queue, Arena *arena, s32 max_commands, s32 max_transforms)
+{
+	queue->commands = PushArray(arena, DrawCommand, max_commands);
+	queue->keys = PushArray(arena, u64, max_commands);
+	queue->num_commands = 0;
+	queue->max_commands = max_commands;
+
+	queue->transforms = PushArray(arena, DrawTransform, max_transforms);
+	queue->num_transforms = 0;
+	queue->max_transforms = max_transforms;
+
+	queue->arena = arena;
+}
+
+s32 PushDrawTransform(DrawQueue *queue, mat4 mvp)
+{
+	assert(queue->num_transforms < queue->max_transforms);
+	DrawTransform *transform = &queue->transforms[queue->num_transforms];
+	transform->mvp = mvp;
+	transform->mvp_inverse = Mat4InverseTranspose(mvp);
+	return queue->num_transforms++;
+}
+
+// maps a float to a u32 whose unsigned order matches the float order
+static u32 SortableFloat(f32 value)
+{
+	u32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000) ? ~bits : bits | 0x80000000;
+}
+
+void SubmitDraw(DrawQueue *queue, Model *model, s32 first_face, s32 num_faces, Program *program, s32 material, s32 transform)
+{
+	assert(queue->num_commands < queue->max_commands);
+
+	// the depth tested against the zbuffer grows towards the camera, so it
+	// is negated for an ascending sort; the centroid stands in for the draw
+	vec3 centroid = Vec3f(0.0f, 0.0f, 0.0f);
+	vec3 *positions = model->positions + first_face * 3;
+	for (s32 i = 0; i < num_faces * 3; i++)
+		centroid = Vec3Add(centroid, positions[i]);
+	centroid = Vec3Scale(centroid, 1.0f / max(num_faces * 3, 1));
+
+	vec4 clip = Mat4MultiplyVec4(queue->transforms[transform].mvp, Vec4f(centroid.x, centroid.y, centroid.z, 1.0f));
+	f32 depth = clip.w != 0.0f ? clip.z / clip.w : 0.0f;
+	u32 depth_key = SortableFloat(-depth) >> 16;
+
+	s32 index = queue->num_commands++;
+	DrawCommand *command = &queue->commands[index];
+	command->model = model;
+	command->first_face = first_face;
+	command->num_faces = num_faces;
+	command->program = program;
+	command->transform = transform;
+
+	queue->keys[index] = ((u64)depth_key << 48) | ((u64)(material & 0xFFFF) << 32) | (u32)index;
+}
+
+void SubmitModel(DrawQueue *queue, Model *model, Program *program, s32 material, s32 transform)
+{
+	for (s32 first = 0; first < model->num_faces; first += DRAW_CLUSTER_FACES)
+		SubmitDraw(queue, model, first, min(DRAW_CLUSTER_FACES, model->num_faces - first), program, material, transform);
+}
+
+// lsd radix sort on the top 32 bits, the index in the low bits is already
+// in order and each pass is stable
+static void SortKeys(u64 *keys, u64 *temp, s32 count)
+{
+	for (s32 shift = 32; shift < 64; shift += 8) {
+		s32 offsets[256] = { 0 };
+		for (s32 i = 0; i < count; i++)
+			offsets[(keys[i] >> shift) & 0xFF]++;
+
+		s32 total = 0;
+		for (s32 i = 0; i < 256; i++) {
+			s32 bucket = offsets[i];
+			offsets[i] = total;
+			total += bucket;
+		}
+		for (s32 i = 0; i < count; i++)
+			temp[offsets[(keys[i] >> shift) & 0xFF]++] = keys[i];
+
+		u64 *swap = keys;
+		keys = temp;
+		temp = swap;
+	}
+}
+
+void FlushDrawQueue(DrawQueue *queue, Backbuffer *buffer, mat4 viewport)
+{
+	size_t mark = ArenaMark(queue->arena);
+	u64 *temp = PushArray(queue->arena, u64, queue->num_commands);
+
+	// four passes, so the sorted keys end up back in queue->keys
+	SortKeys(queue->keys, temp, queue->num_commands);
+
+	for (s32 i = 0; i < queue->num_commands; i++) {
+		DrawCommand *command = &queue->commands[queue->keys[i] & 0xFFFFFFFF];
+		DrawTransform *transform = &queue->transforms[command->transform];
+		Uniforms *uniforms = (Uniforms *)command->program->uniforms;
+		uniforms->mvp = transform->mvp;
+		uniforms->mvp_inverse = transform->mvp_inverse;
+		DrawFaces(buffer, command->program, viewport, command->model, command->first_face, command->num_faces);
+	}
+
+	queue->num_commands = 0;
+	queue->num_transforms = 0;
+	ArenaRestore(queue->arena, mark);
+}
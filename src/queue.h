@@ -0,0 +1,55 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "types.h"
+#include "maths.h"
+
+#include "arena.h"
+#include "platform.h"
+#include "shaders.h"
+#include "model.h"
+
+#define DRAW_CLUSTER_FACES 64
+
+typedef struct DrawCommand {
+	Model *model;
+	s32 first_face;
+	s32 num_faces;
+	Program *program;
+	s32 transform;
+} DrawCommand;
+
+typedef struct DrawTransform {
+	mat4 mvp;
+	mat4 mvp_inverse;
+} DrawTransform;
+
+// per-frame draw list, storage comes from an arena that is reset with the
+// frame (the backbuffer's scratch); sort keys are quantized depth, then
+// material, then submission order
+typedef struct DrawQueue {
+	DrawCommand *commands;
+	u64 *keys;
+	s32 num_commands;
+	s32 max_commands;
+
+	DrawTransform *transforms;
+	s32 num_transforms;
+	s32 max_transforms;
+
+	Arena *arena;
+} DrawQueue;
+
+void BeginDrawQueue(DrawQueue *queue, Arena *arena, s32 max_commands, s32 max_transforms);
+s32 PushDrawTransform(DrawQueue *queue, mat4 mvp);
+
+// material orders state changes among draws at the same quantized depth
+void SubmitDraw(DrawQueue *queue, Model *model, s32 first_face, s32 num_faces, Program *program, s32 material, s32 transform);
+// splits the model into runs of DRAW_CLUSTER_FACES so each is sorted on its own
+void SubmitModel(DrawQueue *queue, Model *model, Program *program, s32 material, s32 transform);
+
+// sorts front to back and draws; the programs' mvp uniforms are left set to
+// the last transform drawn
+void FlushDrawQueue(DrawQueue *queue, Backbuffer *buffer, mat4 viewport);
+
+#endif
@@ -0,0 +1,356 @@
+#include "reorder.h"
+
+#define OVERDRAW_GRID_SIZE 128
+#define OVERDRAW_SPLIT_ACMR 1.0f
+#define OVERDRAW_MIN_CLUSTER 8
+
+typedef struct Cluster {
+	s32 start;
+	s32 end;
+	f32 sort_key;
+} Cluster;
+
+f32 ComputeACMR(IndexedMesh *mesh, s32 cache_size)
+{
+	s32 cache[64];
+	s32 head = 0, misses = 0;
+
+	assert(cache_size <= 64);
+	memset(cache, 0xFF, sizeof(cache));
+
+	for (s32 i = 0; i < mesh->num_indices; i++) {
+		s32 vertex = mesh->indices[i];
+		b32 hit = false;
+		for (s32 j = 0; j < cache_size && !hit; j++)
+			hit = cache[j] == vertex;
+		if (!hit) {
+			cache[head] = vertex;
+			head = (head + 1) % cache_size;
+			misses++;
+		}
+	}
+
+	return mesh->num_indices ? (f32)misses / (mesh->num_indices / 3) : 0.0f;
+}
+
+static f32 EdgeFunction(f32 ax, f32 ay, f32 bx, f32 by, f32 px, f32 py)
+{
+	return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+f32 EstimateOverdraw(IndexedMesh *mesh, Arena *arena)
+{
+	s32 size = OVERDRAW_GRID_SIZE;
+	s64 shaded = 0, covered = 0;
+
+	// fit the grid to the bounding box of the mesh
+	vec3 lower = mesh->positions[0], upper = mesh->positions[0];
+	for (s32 i = 1; i < mesh->num_vertices; i++) {
+		vec3 p = mesh->positions[i];
+		lower = Vec3f(min(lower.x, p.x), min(lower.y, p.y), min(lower.z, p.z));
+		upper = Vec3f(max(upper.x, p.x), max(upper.y, p.y), max(upper.z, p.z));
+	}
+	vec3 extent = Vec3Minus(upper, lower);
+	f32 scale = (size - 1) / max(max(extent.x, extent.y), max(extent.z, 1e-6f));
+
+	size_t mark = ArenaMark(arena);
+	f32 *depths = PushArray(arena, f32, size * size);
+
+	for (s32 view = 0; view < 6; view++) {
+		s32 axis = view >> 1;
+		f32 sign = (view & 1) ? -1.0f : 1.0f;
+		s32 u_axis = (axis + 1) % 3, v_axis = (axis + 2) % 3;
+
+		for (s32 i = 0; i < size * size; i++)
+			depths[i] = -FLT_MAX;
+
+		for (s32 i = 0; i < mesh->num_indices; i += 3) {
+			f32 x[3], y[3], z[3];
+			for (s32 k = 0; k < 3; k++) {
+				f32 *p = (f32 *)&mesh->positions[mesh->indices[i + k]];
+				f32 *o = (f32 *)&lower;
+				x[k] = (p[u_axis] - o[u_axis]) * scale;
+				y[k] = (p[v_axis] - o[v_axis]) * scale;
+				z[k] = p[axis] * sign; // larger is closer, as in the zbuffer
+			}
+
+			f32 area = EdgeFunction(x[0], y[0], x[1], y[1], x[2], y[2]);
+			if (area == 0.0f)
+				continue;
+
+			s32 min_x = max(0, (s32)min(x[0], min(x[1], x[2])));
+			s32 min_y = max(0, (s32)min(y[0], min(y[1], y[2])));
+			s32 max_x = min(size - 1, (s32)max(x[0], max(x[1], x[2])) + 1);
+			s32 max_y = min(size - 1, (s32)max(y[0], max(y[1], y[2])) + 1);
+
+			for (s32 py = min_y; py <= max_y; py++) {
+				for (s32 px = min_x; px <= max_x; px++) {
+					f32 cx = px + 0.5f, cy = py + 0.5f;
+					f32 w0 = EdgeFunction(x[1], y[1], x[2], y[2], cx, cy) / area;
+					f32 w1 = EdgeFunction(x[2], y[2], x[0], y[0], cx, cy) / area;
+					f32 w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						continue;
+
+					f32 depth = w0 * z[0] + w1 * z[1] + w2 * z[2];
+					f32 *stored = &depths[py * size + px];
+					if (*stored < depth) {
+						if (*stored == -FLT_MAX)
+							covered++;
+						*stored = depth;
+						shaded++;
+					}
+				}
+			}
+		}
+	}
+
+	ArenaRestore(arena, mark);
+
+	return covered ? (f32)shaded / covered : 0.0f;
+}
+
+static s32 SkipDeadEnd(s32 *live, s32 *dead_ends, s32 *num_dead_ends, s32 *cursor, s32 num_vertices)
+{
+	while (*num_dead_ends > 0) {
+		s32 vertex = dead_ends[--(*num_dead_ends)];
+		if (live[vertex] > 0)
+			return vertex;
+	}
+	while (*cursor < num_vertices) {
+		s32 vertex = (*cursor)++;
+		if (live[vertex] > 0)
+			return vertex;
+	}
+	return -1;
+}
+
+s32 OptimizeVertexCache(IndexedMesh *mesh, s32 cache_size, s32 *cluster_starts, Arena *arena)
+{
+	s32 num_vertices = mesh->num_vertices;
+	s32 num_triangles = mesh->num_indices / 3;
+	s32 *indices = mesh->indices;
+	s32 num_clusters = 0;
+
+	size_t mark = ArenaMark(arena);
+
+	// vertex to triangle adjacency
+	s32 *live = PushArray(arena, s32, num_vertices);
+	s32 *offsets = PushArray(arena, s32, num_vertices + 1);
+	s32 *adjacency = PushArray(arena, s32, mesh->num_indices);
+	memset(live, 0, sizeof(s32) * num_vertices);
+	for (s32 i = 0; i < mesh->num_indices; i++)
+		live[indices[i]]++;
+	offsets[0] = 0;
+	for (s32 i = 0; i < num_vertices; i++)
+		offsets[i + 1] = offsets[i] + live[i];
+	for (s32 i = 0; i < mesh->num_indices; i++)
+		adjacency[offsets[indices[i] + 1] - live[indices[i]]--] = i / 3;
+	for (s32 i = 0; i < mesh->num_indices; i++)
+		live[indices[i]]++;
+
+	s32 *timestamps = PushArray(arena, s32, num_vertices);
+	s32 *dead_ends = PushArray(arena, s32, mesh->num_indices);
+	s32 *candidates = PushArray(arena, s32, mesh->num_indices);
+	u8 *emitted = PushArray(arena, u8, num_triangles);
+	s32 *output = PushArray(arena, s32, mesh->num_indices);
+	memset(timestamps, 0, sizeof(s32) * num_vertices);
+	memset(emitted, 0, num_triangles);
+
+	s32 num_dead_ends = 0, num_output = 0, cursor = 0;
+	s32 time = cache_size + 1;
+	s32 fan = num_vertices ? 0 : -1;
+	if (num_triangles)
+		cluster_starts[num_clusters++] = 0;
+
+	while (fan >= 0) {
+		s32 num_candidates = 0;
+
+		for (s32 i = offsets[fan]; i < offsets[fan + 1]; i++) {
+			s32 triangle = adjacency[i];
+			if (emitted[triangle])
+				continue;
+
+			for (s32 k = 0; k < 3; k++) {
+				s32 vertex = indices[triangle * 3 + k];
+				output[num_output++] = vertex;
+				dead_ends[num_dead_ends++] = vertex;
+				candidates[num_candidates++] = vertex;
+				live[vertex]--;
+				if (time - timestamps[vertex] > cache_size)
+					timestamps[vertex] = time++;
+			}
+			emitted[triangle] = 1;
+		}
+
+		// prefer the oldest candidate that will still be cached once its
+		// remaining triangles are emitted
+		s32 next = -1, best = -1;
+		for (s32 i = 0; i < num_candidates; i++) {
+			s32 vertex = candidates[i];
+			if (live[vertex] <= 0)
+				continue;
+			s32 priority = 0;
+			if (time - timestamps[vertex] + 2 * live[vertex] <= cache_size)
+				priority = time - timestamps[vertex];
+			if (priority > best) {
+				best = priority;
+				next = vertex;
+			}
+		}
+
+		if (next < 0) {
+			next = SkipDeadEnd(live, dead_ends, &num_dead_ends, &cursor, num_vertices);
+			// a vertex that fell out of the cache starts a new cluster
+			if (next >= 0 && time - timestamps[next] > cache_size)
+				cluster_starts[num_clusters++] = num_output / 3;
+		}
+
+		fan = next;
+	}
+
+	memcpy(indices, output, sizeof(s32) * num_output);
+	ArenaRestore(arena, mark);
+
+	return num_clusters;
+}
+
+static int CompareClusters(const void *left, const void *right)
+{
+	f32 a = ((Cluster *)left)->sort_key;
+	f32 b = ((Cluster *)right)->sort_key;
+	return (a < b) - (a > b);
+}
+
+// tipsify's clusters are too coarse to sort well, so each is cut again once
+// it has paid back the misses of its cold start and runs at about the mesh's
+// acmr; cutting there costs little cache locality
+static s32 SplitClusters(IndexedMesh *mesh, s32 cache_size, s32 *cluster_starts, s32 num_clusters)
+{
+	s32 num_triangles = mesh->num_indices / 3;
+	f32 threshold = ComputeACMR(mesh, cache_size) * OVERDRAW_SPLIT_ACMR;
+	s32 *starts = cluster_starts + num_clusters;
+	s32 num_split = 0;
+
+	// new starts are written after the old ones and moved down afterwards,
+	// the caller's array has room for two entries per triangle
+	for (s32 c = 0; c < num_clusters; c++) {
+		s32 start = cluster_starts[c];
+		s32 end = c + 1 < num_clusters ? cluster_starts[c + 1] : num_triangles;
+		s32 cache[64];
+		s32 head = 0, misses = 0;
+		memset(cache, 0xFF, sizeof(cache));
+
+		starts[num_split++] = start;
+		for (s32 i = start; i < end; i++) {
+			for (s32 k = 0; k < 3; k++) {
+				s32 vertex = mesh->indices[i * 3 + k];
+				b32 hit = false;
+				for (s32 j = 0; j < cache_size && !hit; j++)
+					hit = cache[j] == vertex;
+				if (!hit) {
+					cache[head] = vertex;
+					head = (head + 1) % cache_size;
+					misses++;
+				}
+			}
+
+			s32 count = i + 1 - starts[num_split - 1];
+			if (i + 1 < end && count >= OVERDRAW_MIN_CLUSTER && (f32)misses / count <= threshold) {
+				starts[num_split++] = i + 1;
+				misses = 0;
+			}
+		}
+	}
+
+	memmove(cluster_starts, starts, sizeof(s32) * num_split);
+	return num_split;
+}
+
+s32 OptimizeOverdraw(IndexedMesh *mesh, s32 cache_size, s32 *cluster_starts, s32 num_clusters, Arena *arena)
+{
+	s32 num_triangles = mesh->num_indices / 3;
+	size_t mark = ArenaMark(arena);
+
+	vec3 mesh_centre = Vec3f(0.0f, 0.0f, 0.0f);
+	f32 mesh_area = 0.0f;
+	num_clusters = SplitClusters(mesh, cache_size, cluster_starts, num_clusters);
+
+	Cluster *clusters = PushArray(arena, Cluster, num_clusters);
+	vec3 *centres = PushArray(arena, vec3, num_clusters);
+	vec3 *normals = PushArray(arena, vec3, num_clusters);
+
+	for (s32 c = 0; c < num_clusters; c++) {
+		clusters[c].start = cluster_starts[c];
+		clusters[c].end = c + 1 < num_clusters ? cluster_starts[c + 1] : num_triangles;
+
+		// area weighted centroid and normal of the cluster
+		vec3 centre = Vec3f(0.0f, 0.0f, 0.0f);
+		vec3 normal = Vec3f(0.0f, 0.0f, 0.0f);
+		f32 area = 0.0f;
+		for (s32 i = clusters[c].start; i < clusters[c].end; i++) {
+			vec3 p0 = mesh->positions[mesh->indices[i * 3 + 0]];
+			vec3 p1 = mesh->positions[mesh->indices[i * 3 + 1]];
+			vec3 p2 = mesh->positions[mesh->indices[i * 3 + 2]];
+			vec3 cross = Vec3Cross(Vec3Minus(p1, p0), Vec3Minus(p2, p0));
+			f32 weight = Vec3Length(cross);
+			centre = Vec3Add(centre, Vec3Scale(Vec3Add(Vec3Add(p0, p1), p2), weight / 3.0f));
+			normal = Vec3Add(normal, cross);
+			area += weight;
+		}
+
+		mesh_centre = Vec3Add(mesh_centre, centre);
+		mesh_area += area;
+		centres[c] = area > 0.0f ? Vec3Scale(centre, 1.0f / area) : mesh->positions[mesh->indices[clusters[c].start * 3]];
+		f32 length = Vec3Length(normal);
+		normals[c] = length > 0.0f ? Vec3Scale(normal, 1.0f / length) : normal;
+	}
+	if (mesh_area > 0.0f)
+		mesh_centre = Vec3Scale(mesh_centre, 1.0f / mesh_area);
+
+	// clusters far out along their own normal occlude the rest from most
+	// directions, so they go first
+	for (s32 c = 0; c < num_clusters; c++)
+		clusters[c].sort_key = Vec3Dot(Vec3Minus(centres[c], mesh_centre), normals[c]);
+	qsort(clusters, num_clusters, sizeof(Cluster), CompareClusters);
+
+	s32 *output = PushArray(arena, s32, mesh->num_indices);
+	s32 num_output = 0;
+	for (s32 c = 0; c < num_clusters; c++) {
+		s32 count = (clusters[c].end - clusters[c].start) * 3;
+		memcpy(&output[num_output], &mesh->indices[clusters[c].start * 3], sizeof(s32) * count);
+		num_output += count;
+	}
+	memcpy(mesh->indices, output, sizeof(s32) * num_output);
+
+	ArenaRestore(arena, mark);
+	return num_clusters;
+}
+
+Model *ReorderModel(Model *model, b32 sort_clusters, ReorderStats *stats, Arena *arena)
+{
+	Arena scratch;
+	CreateArena(&scratch, (size_t)model->num_faces * 256 + OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE * sizeof(f32) + ARENA_COMMIT_SIZE);
+
+	IndexedMesh mesh;
+	WeldModel(&mesh, model, &scratch);
+
+	ReorderStats result;
+	result.acmr_before = ComputeACMR(&mesh, VERTEX_CACHE_SIZE);
+	result.overdraw_before = EstimateOverdraw(&mesh, &scratch);
+
+	s32 *cluster_starts = PushArray(&scratch, s32, model->num_faces * 2 + 1);
+	result.num_clusters = OptimizeVertexCache(&mesh, VERTEX_CACHE_SIZE, cluster_starts, &scratch);
+	if (sort_clusters)
+		result.num_clusters = OptimizeOverdraw(&mesh, VERTEX_CACHE_SIZE, cluster_starts, result.num_clusters, &scratch);
+
+	result.acmr_after = ComputeACMR(&mesh, VERTEX_CACHE_SIZE);
+	result.overdraw_after = EstimateOverdraw(&mesh, &scratch);
+
+	Model *reordered = UnweldModel(&mesh, arena);
+	FreeArena(&scratch);
+
+	if (stats)
+		*stats = result;
+	return reordered;
+}
@@ -0,0 +1,42 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <float.h>
+
+#include "types.h"
+#include "maths.h"
+
+#include "arena.h"
+#include "model.h"
+#include "mesh.h"
+
+#define VERTEX_CACHE_SIZE 16
+
+typedef struct ReorderStats {
+	f32 acmr_before; // vertex cache misses per triangle
+	f32 acmr_after;
+	f32 overdraw_before; // depth test passes per covered pixel
+	f32 overdraw_after;
+	s32 num_clusters;
+} ReorderStats;
+
+// fifo cache simulation
+f32 ComputeACMR(IndexedMesh *mesh, s32 cache_size);
+// averaged over orthographic views down each axis, both directions
+f32 EstimateOverdraw(IndexedMesh *mesh, Arena *arena);
+
+// tipsify: fans around cached vertices, writes cluster start triangles
+// wherever the cache had to be restarted
+s32 OptimizeVertexCache(IndexedMesh *mesh, s32 cache_size, s32 *cluster_starts, Arena *arena);
+// splits clusters further, then sorts them so outward facing ones, likely
+// occluders, come first; cluster_starts needs room for two per triangle.
+// opt in: with nothing culled a fixed order is only front to back from
+// some sides, and on the head it moves the estimate far less than it
+// costs in acmr
+s32 OptimizeOverdraw(IndexedMesh *mesh, s32 cache_size, s32 *cluster_starts, s32 num_clusters, Arena *arena);
+
+// load time pass, the returned model has the same faces in a new order;
+// stats always carry both estimates, before and after
+Model *ReorderModel(Model *model, b32 sort_clusters, ReorderStats *stats, Arena *arena);
+
+#endif
@@ -0,0 +1,168 @@
+#include "resolution.h"
+
+// the controller steps down above this share of the budget and up below
+// the lower one, the gap keeps it from flip-flopping between two buckets
+#define SCALE_DOWN_RATIO 1.05f
+#define SCALE_UP_RATIO 0.75f
+
+static const f32 scale_buckets[NUM_SCALE_BUCKETS] = { 1.0f, 0.875f, 0.75f, 0.625f, 0.5f, 0.375f, 0.25f };
+
+void CreateDynamicResolution(DynamicResolution *resolution, f32 target_ms)
+{
+	memset(resolution, 0, sizeof(DynamicResolution));
+	resolution->target_ms = target_ms;
+	QueryPerformanceFrequency(&resolution->frequency);
+}
+
+void DestroyDynamicResolution(DynamicResolution *resolution)
+{
+	if (resolution->internal.memory)
+		FreeBackbuffer(&resolution->internal);
+}
+
+f32 GetResolutionScale(DynamicResolution *resolution)
+{
+	return scale_buckets[resolution->bucket];
+}
+
+static void ChangeBucket(DynamicResolution *resolution, s32 bucket)
+{
+	bucket = max(0, min(NUM_SCALE_BUCKETS - 1, bucket));
+	if (bucket == resolution->bucket)
+		return;
+
+	// old samples were taken at another size and would drag it straight back
+	resolution->bucket = bucket;
+	resolution->num_samples = 0;
+	resolution->next_sample = 0;
+	resolution->frames_since_change = 0;
+}
+
+void SetResolutionScale(DynamicResolution *resolution, f32 scale)
+{
+	s32 bucket = 0;
+	for (s32 i = 1; i < NUM_SCALE_BUCKETS; i++) {
+		if (fabsf(scale_buckets[i] - scale) < fabsf(scale_buckets[bucket] - scale))
+			bucket = i;
+	}
+	ChangeBucket(resolution, bucket);
+}
+
+Backbuffer *BeginScaledFrame(DynamicResolution *resolution, s32 output_width, s32 output_height)
+{
+	f32 scale = scale_buckets[resolution->bucket];
+	s32 width = max(1, (s32)(output_width * scale + 0.5f));
+	s32 height = max(1, (s32)(output_height * scale + 0.5f));
+	Backbuffer *internal = &resolution->internal;
+
+	if (!internal->memory || internal->width != width || internal->height != height) {
+		if (internal->memory)
+			FreeBackbuffer(internal);
+		CreateBackbuffer(internal, width, height);
+		resolution->num_reallocations++;
+	}
+	resolution->output_width = output_width;
+	resolution->output_height = output_height;
+
+	QueryPerformanceCounter(&resolution->frame_start);
+	return internal;
+}
+
+static void UpdateController(DynamicResolution *resolution, f32 frame_ms)
+{
+	resolution->frame_ms[resolution->next_sample] = frame_ms;
+	resolution->next_sample = (resolution->next_sample + 1) % FRAME_TIME_HISTORY;
+	resolution->num_samples = min(resolution->num_samples + 1, FRAME_TIME_HISTORY);
+	resolution->frames_since_change++;
+
+	if (resolution->num_samples < FRAME_TIME_HISTORY / 2)
+		return;
+
+	f32 average = 0.0f;
+	for (s32 i = 0; i < resolution->num_samples; i++)
+		average += resolution->frame_ms[i];
+	average /= resolution->num_samples;
+
+	// cost goes with the pixel count, so the scale that would just meet the
+	// budget is the current one times sqrt(target / average)
+	f32 scale = scale_buckets[resolution->bucket];
+	f32 wanted = scale * sqrtf(resolution->target_ms / max(average, 0.001f));
+
+	if (average > resolution->target_ms * SCALE_DOWN_RATIO) {
+		s32 bucket = resolution->bucket + 1;
+		while (bucket < NUM_SCALE_BUCKETS - 1 && scale_buckets[bucket] > wanted)
+			bucket++;
+		ChangeBucket(resolution, bucket);
+	} else if (average < resolution->target_ms * SCALE_UP_RATIO && resolution->frames_since_change >= FRAME_TIME_HISTORY) {
+		// up one bucket at a time, overshooting costs a visible hitch
+		if (resolution->bucket > 0 && scale_buckets[resolution->bucket - 1] <= wanted)
+			ChangeBucket(resolution, resolution->bucket - 1);
+	}
+}
+
+void EndScaledFrame(DynamicResolution *resolution, Backbuffer *output)
+{
+	assert(output->width == resolution->output_width && output->height == resolution->output_height);
+	UpscaleBackbuffer(output, &resolution->internal);
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	f32 frame_ms = (f32)((now.QuadPart - resolution->frame_start.QuadPart) * 1000.0 / resolution->frequency.QuadPart);
+	resolution->last_frame_ms = frame_ms;
+
+	UpdateController(resolution, frame_ms);
+}
+
+void UpscaleBackbuffer(Backbuffer *output, Backbuffer *source)
+{
+	u32 *pixels = (u32 *)source->memory;
+	u32 *target = (u32 *)output->memory;
+
+	if (output->width == source->width && output->height == source->height) {
+		memcpy(target, pixels, (s64)output->width * output->height * sizeof(u32));
+		return;
+	}
+
+	// per column source offsets and weights are the same for every row
+	s32 last_column = max(source->width - 2, 0);
+	s32 last_row = max(source->height - 2, 0);
+	size_t mark = ArenaMark(&output->scratch);
+	s32 *columns = PushArray(&output->scratch, s32, output->width);
+	u32 *column_weights = PushArray(&output->scratch, u32, output->width);
+	for (s32 x = 0; x < output->width; x++) {
+		f32 u = (x + 0.5f) * source->width / output->width - 0.5f;
+		u = max(0.0f, min(u, (f32)(source->width - 1)));
+		columns[x] = min((s32)u, last_column);
+		column_weights[x] = (u32)((u - columns[x]) * 256.0f);
+	}
+	s32 step_x = source->width > 1 ? 1 : 0;
+
+	for (s32 y = 0; y < output->height; y++) {
+		f32 v = (y + 0.5f) * source->height / output->height - 0.5f;
+		v = max(0.0f, min(v, (f32)(source->height - 1)));
+		s32 row = min((s32)v, last_row);
+		u32 fy = (u32)((v - row) * 256.0f);
+		u32 *top = pixels + row * source->width;
+		u32 *bottom = source->height > 1 ? top + source->width : top;
+		u32 *out = target + y * output->width;
+
+		for (s32 x = 0; x < output->width; x++) {
+			s32 column = columns[x];
+			u32 fx = column_weights[x];
+			u32 p00 = top[column], p01 = top[column + step_x];
+			u32 p10 = bottom[column], p11 = bottom[column + step_x];
+
+			// red and blue share one multiply, green another, the 8 bit
+			// weights leave room between the fields
+			u32 rb_top = ((p00 & 0xFF00FF) * (256 - fx) + (p01 & 0xFF00FF) * fx) >> 8 & 0xFF00FF;
+			u32 rb_bottom = ((p10 & 0xFF00FF) * (256 - fx) + (p11 & 0xFF00FF) * fx) >> 8 & 0xFF00FF;
+			u32 g_top = ((p00 & 0x00FF00) * (256 - fx) + (p01 & 0x00FF00) * fx) >> 8 & 0x00FF00;
+			u32 g_bottom = ((p10 & 0x00FF00) * (256 - fx) + (p11 & 0x00FF00) * fx) >> 8 & 0x00FF00;
+			u32 rb = (rb_top * (256 - fy) + rb_bottom * fy) >> 8 & 0xFF00FF;
+			u32 g = (g_top * (256 - fy) + g_bottom * fy) >> 8 & 0x00FF00;
+			out[x] = rb | g;
+		}
+	}
+
+	ArenaRestore(&output->scratch, mark);
+}
@@ -0,0 +1,56 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <windows.h>
+#include <assert.h>
+#include <string.h>
+
+#include "types.h"
+#include "maths.h"
+
+#include "backbuffer.h"
+
+#define NUM_SCALE_BUCKETS 7
+#define FRAME_TIME_HISTORY 8
+
+// renders at a fraction of the output size picked from the recent frame
+// times, then upscales; the internal buffer is only reallocated when the
+// scale moves to another bucket
+typedef struct DynamicResolution {
+	f32 target_ms;
+	s32 bucket; // index into the scale table, 0 is full size
+
+	f32 frame_ms[FRAME_TIME_HISTORY];
+	s32 num_samples;
+	s32 next_sample;
+	s32 frames_since_change;
+
+	Backbuffer internal;
+	s32 output_width;
+	s32 output_height;
+
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER frame_start;
+
+	// stats
+	s64 num_reallocations;
+	f32 last_frame_ms;
+} DynamicResolution;
+
+void CreateDynamicResolution(DynamicResolution *resolution, f32 target_ms);
+void DestroyDynamicResolution(DynamicResolution *resolution);
+
+f32 GetResolutionScale(DynamicResolution *resolution);
+// pins the scale to the nearest bucket, frame times move it again afterwards
+void SetResolutionScale(DynamicResolution *resolution, f32 scale);
+
+// returns the buffer to render this frame into
+Backbuffer *BeginScaledFrame(DynamicResolution *resolution, s32 output_width, s32 output_height);
+// upscales into output, which is output_width x output_height, and feeds
+// the frame time to the controller
+void EndScaledFrame(DynamicResolution *resolution, Backbuffer *output);
+
+// bilinear, 8 bit fixed point weights
+void UpscaleBackbuffer(Backbuffer *output, Backbuffer *source);
+
+#endif
@@ -0,0 +1,270 @@
+#include "scene.h"
+#include "draw.h"
+#include "incremental.h"
+
+void FreeScene(Scene *scene)
+{
+	FreeModel(scene->model);
+	FreeImage(scene->diffuse_map);
+	FreeImage(scene->normal_map);
+	FreeImage(scene->specular_map);
+	if (scene->lighting_cache)
+		DestroyLightingCache(scene->lighting_cache);
+	if (scene->shadow_map)
+		DestroyShadowMap(scene->shadow_map);
+	FreeArena(&scene->arena);
+}
+
+Camera MakeCamera(vec3 eye, vec3 centre, vec3 up)
+{
+	Camera camera;
+	camera.eye = eye;
+	camera.centre = centre;
+	camera.up = up;
+	camera.coeff = -1.0f / Vec3Length(Vec3Minus(centre, eye));
+	return camera;
+}
+
+mat4 ViewProjection(Camera *camera)
+{
+	mat4 model_view = LookAt(camera->eye, camera->centre, camera->up);
+	mat4 projection = Projection(camera->coeff);
+	return Mat4Multiply(projection, model_view);
+}
+
+// the page tables change here and nowhere else, so renders on other threads
+// never see a slot rewritten under them
+b32 UpdateSceneTextures(Scene *scene)
+{
+	b32 streaming = false;
+	Image *maps[3] = { scene->diffuse_map, scene->normal_map, scene->specular_map };
+	for (s32 i = 0; i < 3; i++) {
+		if (maps[i]->virtual_texture)
+			streaming |= UpdateVirtualTexture(maps[i]->virtual_texture);
+	}
+	return streaming;
+}
+
+void SetupUniforms(Uniforms *uniforms, Scene *scene, Camera *camera)
+{
+	mat4 mvp = ViewProjection(camera);
+
+	uniforms->mvp = mvp;
+	uniforms->mvp_inverse = Mat4InverseTranspose(mvp);
+	uniforms->light = scene->light;
+	uniforms->diffuse_map = scene->diffuse_map;
+	uniforms->normal_map = scene->normal_map;
+	uniforms->specular_map = scene->specular_map;
+
+	uniforms->lighting_cache = scene->lighting_cache;
+	if (scene->lighting_cache)
+		UpdateLightingCache(scene->lighting_cache, scene->diffuse_map, scene->normal_map, scene->specular_map);
+
+	// flat and depth previews never look the shadow map up, so it is not
+	// rerendered for them either
+	uniforms->quality = scene->quality;
+	uniforms->shadow_map = scene->quality < SHADING_FLAT ? scene->shadow_map : NULL;
+	if (uniforms->shadow_map)
+		UpdateShadowMap(scene->shadow_map, scene->model, scene->light);
+}
+
+void DrawFaces(Backbuffer *buffer, Program *program, mat4 viewport, Model *model, s32 first_face, s32 num_faces)
+{
+	Varyings *varyings = (Varyings *)program->varyings;
+
+	for (s32 i = first_face; i < first_face + num_faces; i++) {
+		for (s32 j = 0; j < 3; j++) {
+			varyings->in_positions[j] = model->positions[i * 3 + j];
+			varyings->in_texcoords[j] = model->texcoords[i * 3 + j];
+			varyings->in_normals[j] = model->normals[i * 3 + j];
+		}
+		Draw(buffer, program, viewport);
+	}
+}
+
+void DrawModel(Backbuffer *buffer, Program *program, mat4 viewport, Model *model)
+{
+	DrawFaces(buffer, program, viewport, model, 0, model->num_faces);
+}
+
+void DrawModelDepth(DepthTarget *target, Model *model, mat4 mvp, mat4 viewport)
+{
+	for (s32 i = 0; i < model->num_faces; i++)
+		DrawDepth(target, &model->positions[i * 3], mvp, viewport);
+}
+
+// instances share the program's uniforms, only the mvp pair is swapped per
+// instance; returns how many survived culling
+s32 DrawInstanced(Backbuffer *buffer, Program *program, mat4 viewport, Model *model, mat4 *instances, s32 num_instances)
+{
+	ModelLODs lods = {0};
+	lods.levels[0] = model;
+	lods.num_levels = 1;
+	return DrawInstancedLOD(buffer, program, viewport, &lods, instances, num_instances, 0.0f);
+}
+
+// as DrawInstanced, each instance picks the coarsest level that stays within
+// max_pixel_error of the full model on screen
+s32 DrawInstancedLOD(Backbuffer *buffer, Program *program, mat4 viewport, ModelLODs *lods, mat4 *instances, s32 num_instances, f32 max_pixel_error)
+{
+	Uniforms *uniforms = (Uniforms *)program->uniforms;
+	mat4 view_projection = uniforms->mvp;
+	mat4 view_projection_inverse = uniforms->mvp_inverse;
+	Model *model = lods->levels[0];
+	s32 drawn = 0;
+
+	for (s32 i = 0; i < num_instances; i++) {
+		// Mat4Multiply(a, b) applies a first
+		mat4 mvp = Mat4Multiply(instances[i], view_projection);
+		if (!SphereInFrustum(mvp, model->centre, model->radius))
+			continue;
+
+		f32 radius = ProjectedRadius(mvp, model->centre, model->radius, buffer->width);
+		s32 level = SelectLOD(lods, radius, max_pixel_error);
+
+		uniforms->mvp = mvp;
+		uniforms->mvp_inverse = Mat4InverseTranspose(mvp);
+		DrawModel(buffer, program, viewport, lods->levels[level]);
+		drawn++;
+	}
+
+	uniforms->mvp = view_projection;
+	uniforms->mvp_inverse = view_projection_inverse;
+
+	return drawn;
+}
+
+// the depth buffer as grey, as FragmentShader's depth tier shades each
+// fragment from the depth it was tested with; nothing drawn stays black
+static void ShadeDepth(Backbuffer *buffer)
+{
+	u32 *pixels = (u32 *)buffer->memory;
+	s64 num_pixels = (s64)buffer->width * buffer->height;
+	for (s64 i = 0; i < num_pixels; i++) {
+		u32 depth = (u32)min(255.0f, max(0.0f, buffer->zbuffer[i]));
+		pixels[i] = (depth << 16) | (depth << 8) | depth;
+	}
+}
+
+// reference path: clear, then draw every face with the plain Draw/FragmentShader
+void RenderScene(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	Varyings varyings;
+	Uniforms uniforms;
+	Program program;
+	program.varyings = &varyings;
+	program.uniforms = &uniforms;
+
+	SetupUniforms(&uniforms, scene, camera);
+	program.num_varyings = NumVaryings(&uniforms);
+
+	ClearBackbuffer(buffer);
+	mat4 viewport = Viewport(0, 0, buffer->width, buffer->height);
+
+	// depth only needs no varyings at all, so it goes through the depth
+	// kernel and is turned to grey afterwards
+	if (scene->quality == SHADING_DEPTH) {
+		DepthTarget target = BackbufferDepth(buffer);
+		DrawModelDepth(&target, scene->model, uniforms.mvp, viewport);
+		ShadeDepth(buffer);
+		return;
+	}
+
+	DrawModel(buffer, &program, viewport, scene->model);
+}
+
+// depth first through the depth only kernel, then every pixel is shaded
+// once by the triangle that won it instead of by each one drawn over it
+void RenderScenePrepass(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	Varyings varyings;
+	Uniforms uniforms;
+	Program program;
+	program.varyings = &varyings;
+	program.uniforms = &uniforms;
+
+	SetupUniforms(&uniforms, scene, camera);
+	program.num_varyings = NumVaryings(&uniforms);
+
+	ClearBackbuffer(buffer);
+	mat4 viewport = Viewport(0, 0, buffer->width, buffer->height);
+	DepthTarget target = BackbufferDepth(buffer);
+	DrawModelDepth(&target, scene->model, uniforms.mvp, viewport);
+
+	buffer->depth_test = DEPTH_TEST_EQUAL;
+	DrawModel(buffer, &program, viewport, scene->model);
+	buffer->depth_test = DEPTH_TEST_GREATER;
+}
+
+// same frame through the draw queue, clusters of the model go front to back
+void RenderSceneSorted(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	Varyings varyings;
+	Uniforms uniforms;
+	Program program;
+	program.varyings = &varyings;
+	program.uniforms = &uniforms;
+
+	SetupUniforms(&uniforms, scene, camera);
+	program.num_varyings = NumVaryings(&uniforms);
+
+	ClearBackbuffer(buffer);
+
+	DrawQueue queue;
+	s32 max_commands = (scene->model->num_faces + DRAW_CLUSTER_FACES - 1) / DRAW_CLUSTER_FACES;
+	BeginDrawQueue(&queue, &buffer->scratch, max_commands, 1);
+	s32 transform = PushDrawTransform(&queue, uniforms.mvp);
+	SubmitModel(&queue, scene->model, &program, 0, transform);
+	FlushDrawQueue(&queue, buffer, Viewport(0, 0, buffer->width, buffer->height));
+}
+
+// 4x msaa, shaded once per pixel per triangle and resolved into buffer
+void RenderSceneMultisample(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	Varyings varyings;
+	Uniforms uniforms;
+	Program program;
+	program.varyings = &varyings;
+	program.uniforms = &uniforms;
+
+	SetupUniforms(&uniforms, scene, camera);
+	program.num_varyings = NumVaryings(&uniforms);
+
+	// the resolve writes every pixel, so only the scratch is reset
+	ResetArena(&buffer->scratch);
+	MultisampleBuffer samples;
+	CreateMultisampleBuffer(&samples, buffer->width, buffer->height, &buffer->scratch);
+	ClearMultisampleBuffer(&samples);
+
+	Model *model = scene->model;
+	mat4 viewport = Viewport(0, 0, buffer->width, buffer->height);
+	for (s32 i = 0; i < model->num_faces; i++) {
+		for (s32 j = 0; j < 3; j++) {
+			varyings.in_positions[j] = model->positions[i * 3 + j];
+			varyings.in_texcoords[j] = model->texcoords[i * 3 + j];
+			varyings.in_normals[j] = model->normals[i * 3 + j];
+		}
+		DrawMultisample(&samples, &program, viewport);
+	}
+
+	ResolveMultisampleBuffer(&samples, buffer);
+}
+
+// unique edges of the model, its bounding box and the dirty tile grid,
+// nothing shaded or depth tested
+void RenderWireframe(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	WireMesh *wire = scene->wireframe;
+	mat4 mvp = ViewProjection(camera);
+	mat4 viewport = Viewport(0, 0, buffer->width, buffer->height);
+
+	ClearBackbuffer(buffer);
+
+	LineBatch batch;
+	s32 grid_lines = buffer->width / DIRTY_TILE_SIZE + buffer->height / DIRTY_TILE_SIZE;
+	BeginLineBatch(&batch, buffer, &buffer->scratch, wire->num_edges + 12 + grid_lines);
+	PushTileGrid(&batch, DIRTY_TILE_SIZE, OVERLAY_GRID_COLOUR);
+	PushWireMesh(&batch, wire, mvp, viewport, OVERLAY_EDGE_COLOUR);
+	PushBox(&batch, wire->lower, wire->upper, mvp, viewport, OVERLAY_BOX_COLOUR);
+	DrawLineBatch(&batch);
+}
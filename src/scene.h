@@ -0,0 +1,67 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "types.h"
+#include "maths.h"
+
+#include "platform.h"
+#include "shaders.h"
+#include "image.h"
+#include "model.h"
+#include "lod.h"
+#include "queue.h"
+#include "lighting.h"
+#include "shadow.h"
+#include "overlay.h"
+#include "vtexture.h"
+
+typedef struct Camera {
+	vec3 eye;
+	vec3 centre;
+	vec3 up;
+	f32 coeff;
+} Camera;
+
+typedef struct Scene {
+	Model *model;
+	Image *diffuse_map;
+	Image *normal_map;
+	Image *specular_map;
+	vec3 light;
+
+	// optional, rebaked when the maps change and destroyed by FreeScene
+	LightingCache *lighting_cache;
+	// optional, rerendered when the model or light changes and destroyed
+	// by FreeScene
+	ShadowMap *shadow_map;
+	// optional, what RenderWireframe draws
+	WireMesh *wireframe;
+	// SHADING_FULL unless a preview asks for less
+	ShadingQuality quality;
+
+	// backing store for the assets above, released by FreeScene
+	Arena arena;
+} Scene;
+
+void FreeScene(Scene *scene);
+
+Camera MakeCamera(vec3 eye, vec3 centre, vec3 up);
+mat4 ViewProjection(Camera *camera);
+// commits the pages the last frame asked for into any virtual maps; called
+// by whoever owns the frame, before it renders and while nothing samples
+// them. true while pages are still changing
+b32 UpdateSceneTextures(Scene *scene);
+void SetupUniforms(Uniforms *uniforms, Scene *scene, Camera *camera);
+
+void DrawFaces(Backbuffer *buffer, Program *program, mat4 viewport, Model *model, s32 first_face, s32 num_faces);
+void DrawModel(Backbuffer *buffer, Program *program, mat4 viewport, Model *model);
+void DrawModelDepth(DepthTarget *target, Model *model, mat4 mvp, mat4 viewport);
+s32 DrawInstanced(Backbuffer *buffer, Program *program, mat4 viewport, Model *model, mat4 *instances, s32 num_instances);
+s32 DrawInstancedLOD(Backbuffer *buffer, Program *program, mat4 viewport, ModelLODs *lods, mat4 *instances, s32 num_instances, f32 max_pixel_error);
+void RenderScene(Backbuffer *buffer, Scene *scene, Camera *camera);
+void RenderScenePrepass(Backbuffer *buffer, Scene *scene, Camera *camera);
+void RenderSceneSorted(Backbuffer *buffer, Scene *scene, Camera *camera);
+void RenderSceneMultisample(Backbuffer *buffer, Scene *scene, Camera *camera);
+void RenderWireframe(Backbuffer *buffer, Scene *scene, Camera *camera);
+
+#endif
@@ -0,0 +1,433 @@
+#include <winsock2.h>
+#include <afunix.h>
+
+#include "server.h"
+#include "compress.h"
+
+#pragma comment(lib, "ws2_32.lib")
+#pragma warning(disable : 4996)
+
+static s64 AssetSize(AssetType type, void *result)
+{
+	if (type == ASSET_MODEL) {
+		Model *model = (Model *)result;
+		return (s64)model->num_faces * 3 * (sizeof(vec3) * 2 + sizeof(vec2));
+	}
+	return ImageSize((Image *)result);
+}
+
+static void FreeCachedAsset(CachedAsset *asset)
+{
+	if (asset->result && asset->type == ASSET_MODEL)
+		FreeModel((Model *)asset->result);
+	else if (asset->result)
+		FreeImage((Image *)asset->result);
+	memset(asset, 0, sizeof(CachedAsset));
+}
+
+void CreateAssetCache(AssetCache *cache, JobSystem *jobs, s64 max_size)
+{
+	memset(cache, 0, sizeof(AssetCache));
+	cache->jobs = jobs;
+	cache->max_size = max_size;
+	InitializeCriticalSection(&cache->lock);
+	InitializeConditionVariable(&cache->asset_loaded);
+}
+
+void DestroyAssetCache(AssetCache *cache)
+{
+	for (s32 i = 0; i < MAX_CACHED_ASSETS; i++) {
+		CachedAsset *asset = &cache->assets[i];
+		assert(asset->users == 0);
+		if (asset->used)
+			FreeCachedAsset(asset);
+	}
+	DeleteCriticalSection(&cache->lock);
+}
+
+// frees the least recently used asset nobody is rendering with, returns
+// its now empty slot or NULL if everything is pinned
+static CachedAsset *EvictAsset(AssetCache *cache)
+{
+	CachedAsset *oldest = NULL;
+	for (s32 i = 0; i < MAX_CACHED_ASSETS; i++) {
+		CachedAsset *asset = &cache->assets[i];
+		if (asset->used && asset->loaded && asset->users == 0 && (!oldest || asset->last_used < oldest->last_used))
+			oldest = asset;
+	}
+
+	if (oldest) {
+		cache->size -= oldest->size;
+		cache->evictions++;
+		FreeCachedAsset(oldest);
+	}
+	return oldest;
+}
+
+static void ReleaseLocked(AssetCache *cache, CachedAsset *asset)
+{
+	assert(asset->users > 0);
+	asset->users--;
+
+	// failed loads are not remembered, the file may turn up later
+	if (asset->users == 0 && !asset->result)
+		FreeCachedAsset(asset);
+
+	// an asset over the budget stays while pinned and goes once it is not
+	while (cache->size > cache->max_size && EvictAsset(cache))
+		;
+}
+
+CachedAsset *AcquireAsset(AssetCache *cache, AssetType type, const char *path)
+{
+	if (strlen(path) >= MAX_ASSET_PATH)
+		return NULL;
+
+	EnterCriticalSection(&cache->lock);
+
+	CachedAsset *asset = NULL;
+	CachedAsset *free_slot = NULL;
+	for (s32 i = 0; i < MAX_CACHED_ASSETS; i++) {
+		CachedAsset *slot = &cache->assets[i];
+		if (!slot->used) {
+			if (!free_slot)
+				free_slot = slot;
+		} else if (slot->type == type && strcmp(slot->path, path) == 0) {
+			asset = slot;
+			break;
+		}
+	}
+
+	if (asset) {
+		asset->users++;
+		cache->hits++;
+		while (!asset->loaded)
+			SleepConditionVariableCS(&cache->asset_loaded, &cache->lock, INFINITE);
+	} else {
+		asset = free_slot ? free_slot : EvictAsset(cache);
+		if (!asset) {
+			LeaveCriticalSection(&cache->lock);
+			return NULL;
+		}
+		asset->used = true;
+		asset->type = type;
+		strcpy(asset->path, path);
+		asset->users = 1;
+		cache->misses++;
+
+		// the slot is pinned and marked loading, so the lock can go while
+		// the file is read
+		LeaveCriticalSection(&cache->lock);
+		void *result;
+		if (type == ASSET_MODEL)
+			result = LoadModelParallel(cache->jobs, path, NULL);
+		else
+			result = ReadFromTGA(path, NULL);
+		EnterCriticalSection(&cache->lock);
+
+		asset->result = result;
+		asset->size = result ? AssetSize(type, result) : 0;
+		asset->loaded = true;
+		cache->size += asset->size;
+		WakeAllConditionVariable(&cache->asset_loaded);
+	}
+
+	asset->last_used = ++cache->clock;
+	if (!asset->result) {
+		ReleaseLocked(cache, asset);
+		asset = NULL;
+	}
+
+	LeaveCriticalSection(&cache->lock);
+	return asset;
+}
+
+void ReleaseAsset(AssetCache *cache, CachedAsset *asset)
+{
+	EnterCriticalSection(&cache->lock);
+	ReleaseLocked(cache, asset);
+	LeaveCriticalSection(&cache->lock);
+}
+
+typedef struct Connection {
+	RenderServer *server;
+	SOCKET socket;
+
+	// bytes received past the end of the current request
+	char pending[MAX_REQUEST_SIZE];
+	s32 num_pending;
+
+	// kept between requests, recreated when the size changes
+	Backbuffer buffer;
+	b32 has_buffer;
+} Connection;
+
+// false once the client hangs up or a request does not fit
+static b32 ReceiveRequest(Connection *connection, char *request)
+{
+	for (;;) {
+		char *end = (char *)memchr(connection->pending, '\n', connection->num_pending);
+		if (end) {
+			s32 length = (s32)(end - connection->pending);
+			memcpy(request, connection->pending, length);
+			request[length] = '\0';
+			if (length > 0 && request[length - 1] == '\r')
+				request[length - 1] = '\0';
+
+			connection->num_pending -= length + 1;
+			memmove(connection->pending, end + 1, connection->num_pending);
+			return true;
+		}
+
+		if (connection->num_pending == MAX_REQUEST_SIZE)
+			return false;
+		s32 received = recv(connection->socket, connection->pending + connection->num_pending, MAX_REQUEST_SIZE - connection->num_pending, 0);
+		if (received <= 0)
+			return false;
+		connection->num_pending += received;
+	}
+}
+
+static b32 SendAll(SOCKET socket, const void *data, s64 size)
+{
+	const char *cursor = (const char *)data;
+	while (size > 0) {
+		s32 sent = send(socket, cursor, (s32)min(size, (s64)1 << 30), 0);
+		if (sent <= 0)
+			return false;
+		cursor += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+static b32 SendError(Connection *connection, const char *reason)
+{
+	char reply[MAX_REQUEST_SIZE];
+	s32 length = snprintf(reply, sizeof(reply), "error %s\n", reason);
+	return SendAll(connection->socket, reply, min(length, (s32)sizeof(reply) - 1));
+}
+
+static b32 ParseImageFormat(const char *name, ImageFormat *format)
+{
+	if (strcmp(name, "tga") == 0)
+		*format = IMAGE_FORMAT_TGA;
+	else if (strcmp(name, "ppm") == 0)
+		*format = IMAGE_FORMAT_PPM;
+	else if (strcmp(name, "png") == 0)
+		*format = IMAGE_FORMAT_PNG;
+	else
+		return false;
+	return true;
+}
+
+// assets have to be under the server's directory
+static b32 IsAssetPath(const char *path)
+{
+	return path[0] != '/' && path[0] != '\\' && strchr(path, ':') == NULL && strstr(path, "..") == NULL;
+}
+
+// false when the connection should close: the reply could not be sent,
+// or the client asked the server to quit
+static b32 HandleRequest(Connection *connection, char *request)
+{
+	RenderServer *server = connection->server;
+	char command[16];
+	char paths[4][MAX_ASSET_PATH];
+	char format_name[16];
+	char quality_name[16];
+	s32 width, height;
+	vec3 eye, centre;
+
+	// path widths follow MAX_ASSET_PATH
+	s32 num_fields = sscanf(request, "%15s %259s %259s %259s %259s %d %d %15s %15s %f %f %f %f %f %f",
+		command, paths[0], paths[1], paths[2], paths[3], &width, &height, format_name, quality_name,
+		&eye.x, &eye.y, &eye.z, &centre.x, &centre.y, &centre.z);
+
+	if (num_fields >= 1 && strcmp(command, "quit") == 0) {
+		SendAll(connection->socket, "ok 0\n", 5);
+		StopRenderServer(server);
+		return false;
+	}
+	if (num_fields < 1 || strcmp(command, "render") != 0)
+		return SendError(connection, "unknown request");
+	if (num_fields != 15)
+		return SendError(connection, "malformed request");
+	if (width <= 0 || height <= 0 || width > MAX_RENDER_SIZE || height > MAX_RENDER_SIZE)
+		return SendError(connection, "bad resolution");
+	if (Vec3Length(Vec3Minus(centre, eye)) == 0.0f)
+		return SendError(connection, "bad camera");
+
+	ImageFormat format;
+	ShadingQuality quality;
+	if (!ParseImageFormat(format_name, &format))
+		return SendError(connection, "bad format");
+	if (!ParseShadingQuality(quality_name, &quality))
+		return SendError(connection, "bad quality");
+
+	for (s32 i = 0; i < 4; i++) {
+		if (!IsAssetPath(paths[i]))
+			return SendError(connection, "bad asset path");
+	}
+
+	LARGE_INTEGER frequency, start, loaded, rendered;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&start);
+
+	CachedAsset *assets[4] = { 0 };
+	for (s32 i = 0; i < 4; i++) {
+		assets[i] = AcquireAsset(&server->cache, i == 0 ? ASSET_MODEL : ASSET_TEXTURE, paths[i]);
+		if (!assets[i])
+			break;
+	}
+	if (!assets[0] || !assets[1] || !assets[2] || !assets[3]) {
+		char reason[MAX_ASSET_PATH + 32];
+		for (s32 i = 0; i < 4; i++) {
+			if (assets[i]) {
+				ReleaseAsset(&server->cache, assets[i]);
+			} else {
+				snprintf(reason, sizeof(reason), "cannot load %s", paths[i]);
+				break;
+			}
+		}
+		return SendError(connection, reason);
+	}
+	QueryPerformanceCounter(&loaded);
+
+	Scene scene;
+	memset(&scene, 0, sizeof(Scene));
+	scene.model = (Model *)assets[0]->result;
+	scene.diffuse_map = (Image *)assets[1]->result;
+	scene.normal_map = (Image *)assets[2]->result;
+	scene.specular_map = (Image *)assets[3]->result;
+	scene.light = Vec3f(1.0f, 1.0f, 1.0f);
+	scene.quality = quality;
+	Camera camera = MakeCamera(eye, centre, Vec3f(0.0f, 1.0f, 0.0f));
+
+	Backbuffer *buffer = &connection->buffer;
+	if (connection->has_buffer && (buffer->width != width || buffer->height != height)) {
+		FreeBackbuffer(buffer);
+		connection->has_buffer = false;
+	}
+	if (!connection->has_buffer) {
+		CreateBackbuffer(buffer, width, height);
+		connection->has_buffer = true;
+	}
+
+	RenderScene(buffer, &scene, &camera);
+	for (s32 i = 0; i < 4; i++)
+		ReleaseAsset(&server->cache, assets[i]);
+	QueryPerformanceCounter(&rendered);
+
+	s64 size;
+	u8 *encoded = EncodeBackbuffer(buffer, format, &size);
+	if (!encoded)
+		return SendError(connection, "cannot encode");
+
+	char header[64];
+	s32 header_size = snprintf(header, sizeof(header), "ok %lld\n", size);
+	b32 sent = SendAll(connection->socket, header, header_size) && SendAll(connection->socket, encoded, size);
+	free(encoded);
+
+	printf("%s %dx%d %s: load %.2f ms, render %.2f ms\n", paths[0], width, height, quality_name,
+		(loaded.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart,
+		(rendered.QuadPart - loaded.QuadPart) * 1000.0 / frequency.QuadPart);
+	return sent;
+}
+
+static DWORD WINAPI ConnectionThread(LPVOID parameter)
+{
+	Connection *connection = (Connection *)parameter;
+	RenderServer *server = connection->server;
+	char request[MAX_REQUEST_SIZE];
+
+	while (ReceiveRequest(connection, request)) {
+		if (!HandleRequest(connection, request))
+			break;
+	}
+
+	closesocket(connection->socket);
+	if (connection->has_buffer)
+		FreeBackbuffer(&connection->buffer);
+	free(connection);
+
+	InterlockedDecrement(&server->num_connections);
+	return 0;
+}
+
+b32 StartRenderServer(RenderServer *server, const char *path, JobSystem *jobs)
+{
+	memset(server, 0, sizeof(RenderServer));
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	if (strlen(path) >= sizeof(address.sun_path))
+		return false;
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		return false;
+
+	SOCKET listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener == INVALID_SOCKET) {
+		WSACleanup();
+		return false;
+	}
+
+	// the socket file outlives a server that was killed
+	DeleteFileA(path);
+	if (bind(listener, (struct sockaddr *)&address, sizeof(address)) == SOCKET_ERROR ||
+		listen(listener, SOMAXCONN) == SOCKET_ERROR) {
+		closesocket(listener);
+		WSACleanup();
+		return false;
+	}
+
+	server->listener = (UINT_PTR)listener;
+	strcpy(server->path, path);
+	CreateAssetCache(&server->cache, jobs, ASSET_CACHE_SIZE);
+	server->running = true;
+	return true;
+}
+
+void RunRenderServer(RenderServer *server)
+{
+	while (server->running) {
+		SOCKET client = accept((SOCKET)server->listener, NULL, NULL);
+		if (client == INVALID_SOCKET)
+			continue;
+
+		Connection *connection = (Connection *)calloc(1, sizeof(Connection));
+		connection->server = server;
+		connection->socket = client;
+
+		InterlockedIncrement(&server->num_connections);
+		HANDLE thread = CreateThread(NULL, 0, ConnectionThread, connection, 0, NULL);
+		if (thread) {
+			CloseHandle(thread);
+		} else {
+			closesocket(client);
+			free(connection);
+			InterlockedDecrement(&server->num_connections);
+		}
+	}
+}
+
+void StopRenderServer(RenderServer *server)
+{
+	// closing the listener fails the accept RunRenderServer is blocked in
+	if (InterlockedExchange(&server->running, 0))
+		closesocket((SOCKET)server->listener);
+}
+
+void DestroyRenderServer(RenderServer *server)
+{
+	while (server->num_connections > 0)
+		Sleep(1);
+
+	DestroyAssetCache(&server->cache);
+	DeleteFileA(server->path);
+	WSACleanup();
+}
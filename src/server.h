@@ -0,0 +1,86 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <windows.h>
+
+#include "types.h"
+
+#include "jobs.h"
+#include "assets.h"
+#include "scene.h"
+#include "writer.h"
+
+#define MAX_CACHED_ASSETS 64
+#define ASSET_CACHE_SIZE ((s64)512 * 1024 * 1024) // bytes of parsed assets kept resident
+#define MAX_REQUEST_SIZE 2048
+#define MAX_RENDER_SIZE 4096
+
+// a model or map kept parsed between requests; pinned while any request
+// renders with it, evicted least recently used first once it is not
+typedef struct CachedAsset {
+	b32 used; // slot holds an asset
+	AssetType type;
+	char path[MAX_ASSET_PATH];
+
+	void *result; // NULL until loaded, and after a failed load
+	b32 loaded;
+	s32 users;
+	s64 size;
+	u64 last_used;
+} CachedAsset;
+
+// misses load on the requesting thread, models parse in parallel on the
+// job system; a second request for an asset still loading waits for it
+typedef struct AssetCache {
+	JobSystem *jobs;
+	CachedAsset assets[MAX_CACHED_ASSETS];
+	s64 size;
+	s64 max_size;
+	u64 clock;
+
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE asset_loaded;
+
+	// stats
+	s64 hits;
+	s64 misses;
+	s64 evictions;
+} AssetCache;
+
+void CreateAssetCache(AssetCache *cache, JobSystem *jobs, s64 max_size);
+// nothing may be pinned
+void DestroyAssetCache(AssetCache *cache);
+
+// pins the asset, loading it on a miss; NULL if it fails to load or every
+// slot is pinned
+CachedAsset *AcquireAsset(AssetCache *cache, AssetType type, const char *path);
+void ReleaseAsset(AssetCache *cache, CachedAsset *asset);
+
+// one line per request, answered before the next is read:
+//
+//   render <model> <diffuse> <normal> <specular> <width> <height> <tga|ppm|png> <quality> <eye x y z> <centre x y z>
+//   quit
+//
+// assets are paths relative to the server's directory; the reply is
+// "ok <size>\n" followed by the encoded image, or "error <reason>\n".
+// quit is answered "ok 0\n", closes that connection and stops accepting;
+// the server exits once the other connections have closed
+typedef struct RenderServer {
+	UINT_PTR listener; // SOCKET, winsock stays out of this header
+	char path[MAX_ASSET_PATH];
+	AssetCache cache;
+	volatile LONG running;
+	volatile LONG num_connections;
+} RenderServer;
+
+// binds a unix domain socket at path, replacing a stale one
+b32 StartRenderServer(RenderServer *server, const char *path, JobSystem *jobs);
+// accepts until StopRenderServer or a quit request, each connection
+// served on its own thread so requests render concurrently
+void RunRenderServer(RenderServer *server);
+// safe to call from any thread, and more than once
+void StopRenderServer(RenderServer *server);
+// waits for open connections to close
+void DestroyRenderServer(RenderServer *server);
+
+#endif
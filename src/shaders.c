@@ -1,4 +1,70 @@
 #include "shaders.h"
+#include "lighting.h"
+#include "shadow.h"
+
+b32 ParseShadingQuality(const char *name, ShadingQuality *quality)
+{
+	static const char *names[] = { "full", "gouraud", "flat", "depth" };
+	for (s32 i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		size_t length = strlen(names[i]);
+		if (strncmp(name, names[i], length) == 0 && (name[length] == '\0' || name[length] == ' ')) {
+			*quality = (ShadingQuality)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+s32 NumVaryings(Uniforms *uniforms)
+{
+	if (uniforms->quality == SHADING_DEPTH)
+		return 0;
+	if (uniforms->quality != SHADING_FULL)
+		return NUM_LIGHTING_VARYINGS;
+	return uniforms->shadow_map ? NUM_SHADOW_VARYINGS : NUM_VARYINGS;
+}
+
+// diffuse plus weighted specular for one normal, both vectors taken
+// through the mvp the same way
+static f32 Lighting(vec3 normal, vec3 light, f32 specular_power, f32 specular_weight, mat4 mvp)
+{
+	normal = Vec3Normalise(Vec3(Mat4MultiplyVec4(mvp, Vec4(normal, 1.0f))));
+	light = Vec3Normalise(Vec3(Mat4MultiplyVec4(mvp, Vec4(light, 1.0f))));
+
+	// reflected = 2 * normal * dot(normal, light) - light
+	float intensity = Vec3Dot(normal, light);
+	vec3 reflected = Vec3Scale(normal, intensity * 2.0f);
+	reflected = Vec3Normalise(Vec3Minus(reflected, light));
+
+	float specular = (float)pow(max(reflected.z, 0.0f), specular_power);
+	float diffuse = max(intensity, 0.0f);
+	return diffuse + specular_weight * specular;
+}
+
+// the single lighting term gouraud and flat interpolate
+static f32 VertexLighting(s32 vertex, Varyings *varyings, Uniforms *uniforms)
+{
+	if (uniforms->quality == SHADING_FLAT) {
+		vec3 *positions = varyings->in_positions;
+		vec3 normal = Vec3Cross(Vec3Minus(positions[1], positions[0]), Vec3Minus(positions[2], positions[0]));
+		return Lighting(Vec3Normalise(normal), uniforms->light, 1.0f, 0.0f, uniforms->mvp);
+	}
+
+	vec2 texcoord = varyings->in_texcoords[vertex];
+	Image *specular_map = uniforms->specular_map;
+	f32 specular_power;
+	if (uniforms->lighting_cache)
+		specular_power = SampleLightingCache(uniforms->lighting_cache, texcoord)->specular;
+	else if (specular_map->format == TEXTURE_FORMAT_R8)
+		specular_power = SampleR8(specular_map, texcoord);
+	else
+		specular_power = SampleTexture(specular_map, texcoord).b;
+
+	f32 lighting = Lighting(varyings->in_normals[vertex], uniforms->light, specular_power, 0.6f, uniforms->mvp);
+	if (uniforms->shadow_map)
+		lighting *= SampleShadow(uniforms->shadow_map, varyings->in_positions[vertex]);
+	return lighting;
+}
 
 vec4 VertexShader(s32 vertex, void *varyings_, void *uniforms_)
 {
@@ -9,64 +75,106 @@ vec4 VertexShader(s32 vertex, void *varyings_, void *uniforms_)
 	vec2 in_texcoord = varyings->in_texcoords[vertex];
 	mat4 mvp = uniforms->mvp;
 
-	vec2 *out_texcoord = &varyings->out_texcoords[vertex];
-	*out_texcoord = in_texcoord;
+	f32 *out_texcoord = &varyings->out_varyings[vertex][VARYING_TEXCOORD];
+	out_texcoord[0] = in_texcoord.x;
+	out_texcoord[1] = in_texcoord.y;
+
+	if (uniforms->quality == SHADING_FULL && uniforms->shadow_map) {
+		f32 *out_position = &varyings->out_varyings[vertex][VARYING_POSITION];
+		out_position[0] = in_position.x;
+		out_position[1] = in_position.y;
+		out_position[2] = in_position.z;
+	}
 
 	vec4 position = Vec4(in_position, 1.0f);
 	vec4 clip_coord = Mat4MultiplyVec4(mvp, position);
 
+	if (uniforms->quality == SHADING_GOURAUD || uniforms->quality == SHADING_FLAT)
+		varyings->out_varyings[vertex][VARYING_LIGHTING] = VertexLighting(vertex, varyings, uniforms);
+
 	return clip_coord;
 }
 
+static vec3 ShadeColour(vec3 albedo, f32 lighting)
+{
+	vec3 colour = albedo;
+	colour.r = 5.0f + colour.r * lighting;
+	colour.g = 5.0f + colour.g * lighting;
+	colour.b = 5.0f + colour.b * lighting;
+	colour.r = min(255.0f, colour.r);
+	colour.g = min(255.0f, colour.g);
+	colour.b = min(255.0f, colour.b);
+
+	return colour;
+}
+
 vec3 FragmentShader(void *varyings_, void *uniforms_)
 {
 	Varyings *varyings = (Varyings *)varyings_;
 	Uniforms *uniforms = (Uniforms *)uniforms_;
 
-	vec2 in_texcoord = varyings->in_texcoord;
+	f32 *in_varyings = varyings->in_varyings;
+	vec2 in_texcoord = Vec2f(in_varyings[VARYING_TEXCOORD], in_varyings[VARYING_TEXCOORD + 1]);
 
 	mat4 mvp = uniforms->mvp;
-	mat4 mvp_inverse = uniforms->mvp_inverse;
 	vec3 light = uniforms->light;
 	Image *diffuse_map = uniforms->diffuse_map;
 	Image *normal_map = uniforms->normal_map;
 	Image *specular_map = uniforms->specular_map;
+	LightingCache *lighting_cache = uniforms->lighting_cache;
 
-	// transfor normal
-	vec3 normal = SampleTexture(normal_map, in_texcoord);
-	normal.x = normal.r / 255.0f * 2.0f - 1.0f;
-	normal.y = normal.g / 255.0f * 2.0f - 1.0f;
-	normal.z = normal.b / 255.0f * 2.0f - 1.0f;
-	vec4 normal_4f = Vec4(normal, 1.0f);
-	normal_4f = Mat4MultiplyVec4(mvp, normal_4f);
-	normal = Vec3Normalise(Vec3(normal_4f));
-
-	// transform light
-	vec4 light_4f = Vec4(light, 1.0f);
-	light_4f = Mat4MultiplyVec4(mvp, light_4f);
-	light = Vec3Normalise(Vec3(light_4f));
+	// the depth the rasterizer tested, not an interpolated varying, so it
+	// matches RenderScene's depth kernel pixel for pixel
+	if (uniforms->quality == SHADING_DEPTH) {
+		f32 depth = min(255.0f, max(0.0f, varyings->in_depth));
+		return Vec3f(depth, depth, depth);
+	}
 
-	// reflected = 2 * normal * dot(normal, light) - light
-	float intensity = Vec3Dot(normal, light);
-	vec3 reflected = Vec3Scale(normal, intensity * 2.0f);
-	reflected = Vec3Normalise(Vec3Minus(reflected, light));
+	// the cheaper tiers only interpolate what VertexShader lit
+	if (uniforms->quality == SHADING_FLAT)
+		return ShadeColour(Vec3f(FLAT_ALBEDO, FLAT_ALBEDO, FLAT_ALBEDO), in_varyings[VARYING_LIGHTING]);
+	if (uniforms->quality == SHADING_GOURAUD) {
+		vec3 albedo;
+		if (lighting_cache) {
+			BakedTexel *texel = SampleLightingCache(lighting_cache, in_texcoord);
+			albedo = Vec3f(texel->albedo[0], texel->albedo[1], texel->albedo[2]);
+		} else {
+			albedo = SampleTexture(diffuse_map, in_texcoord);
+		}
+		return ShadeColour(albedo, in_varyings[VARYING_LIGHTING]);
+	}
 
-	// specular factor
-	vec3 spec = SampleTexture(specular_map, in_texcoord);
-	float specular = spec.b;
-	float base = max(reflected.z, 0.0f);
-	specular = (float)pow(base, specular);
+	vec3 normal;
+	f32 specular_power;
+	vec3 albedo;
+	if (lighting_cache) {
+		BakedTexel *texel = SampleLightingCache(lighting_cache, in_texcoord);
+		normal.x = baked_normal_decode[texel->normal[0]];
+		normal.y = baked_normal_decode[texel->normal[1]];
+		normal.z = baked_normal_decode[texel->normal[2]];
+		specular_power = texel->specular;
+		albedo = Vec3f(texel->albedo[0], texel->albedo[1], texel->albedo[2]);
+	} else {
+		if (normal_map->format == TEXTURE_FORMAT_SNORM8X4) {
+			normal = SampleNormal(normal_map, in_texcoord);
+		} else {
+			normal = SampleTexture(normal_map, in_texcoord);
+			normal.x = normal.r / 255.0f * 2.0f - 1.0f;
+			normal.y = normal.g / 255.0f * 2.0f - 1.0f;
+			normal.z = normal.b / 255.0f * 2.0f - 1.0f;
+		}
+		if (specular_map->format == TEXTURE_FORMAT_R8)
+			specular_power = SampleR8(specular_map, in_texcoord);
+		else
+			specular_power = SampleTexture(specular_map, in_texcoord).b;
+		albedo = SampleTexture(diffuse_map, in_texcoord);
+	}
 
-	// diffuse factor
-	float diffuse = max(intensity, 0.0f);
+	float lighting = Lighting(normal, light, specular_power, 0.6f, mvp);
+	if (uniforms->shadow_map) {
+		vec3 position = Vec3f(in_varyings[VARYING_POSITION], in_varyings[VARYING_POSITION + 1], in_varyings[VARYING_POSITION + 2]);
+		lighting *= SampleShadow(uniforms->shadow_map, position);
+	}
 
-	vec3 colour = SampleTexture(diffuse_map, in_texcoord);
-	colour.r = 5.0f + colour.r * (diffuse + 0.6f * specular);
-	colour.g = 5.0f + colour.g * (diffuse + 0.6f * specular);
-	colour.b = 5.0f + colour.b * (diffuse + 0.6f * specular);
-	colour.r = min(255.0f, colour.r);
-	colour.g = min(255.0f, colour.g);
-	colour.b = min(255.0f, colour.b);
-
-	return colour;
-}
\ No newline at end of file
+	return ShadeColour(albedo, lighting);
+}
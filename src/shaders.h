@@ -6,16 +6,42 @@
 
 #include "image.h"
 
+// vertex outputs are flat float components, the rasterizer interpolates
+// the first Program.num_varyings of them perspective correctly
+#define MAX_VARYINGS 16 // a multiple of 4, interpolation runs 4 wide
+
+// slots written by VertexShader, the model space position only when
+// there is a shadow map to look it up in; gouraud and flat light per
+// vertex and pass one lighting term in the position's slot instead
+#define VARYING_TEXCOORD 0
+#define VARYING_POSITION 2
+#define VARYING_LIGHTING 2
+#define NUM_VARYINGS 2
+#define NUM_SHADOW_VARYINGS 5
+#define NUM_LIGHTING_VARYINGS 3
+
+#define FLAT_ALBEDO 200.0f
+
+// most to least expensive, each tier runs through the same Draw
+typedef enum ShadingQuality {
+	SHADING_FULL, // per pixel normal map, specular map and shadow
+	SHADING_GOURAUD, // lit per vertex from the model normals, diffuse map per pixel
+	SHADING_FLAT, // lit per face, untextured and unshadowed
+	SHADING_DEPTH, // depth as grey, exactly what the fragment was depth tested with
+} ShadingQuality;
+
 typedef struct Varyings {
 	// input vertex shader
 	vec3 in_positions[3];
 	vec2 in_texcoords[3];
+	vec3 in_normals[3];
 
 	// output vertex shader
-	vec2 out_texcoords[3];
+	f32 out_varyings[3][MAX_VARYINGS];
 
 	// input fragment shader
-	vec2 in_texcoord;
+	f32 in_varyings[MAX_VARYINGS];
+	f32 in_depth; // screen depth, 0-255, as stored in the zbuffer
 } Varyings;
 
 typedef struct Uniforms {
@@ -25,13 +51,22 @@ typedef struct Uniforms {
 	Image *diffuse_map;
 	Image *normal_map;
 	Image *specular_map;
+	struct LightingCache *lighting_cache; // optional, replaces the map decode
+	struct ShadowMap *shadow_map; // optional, attenuates occluded fragments
+	ShadingQuality quality;
 } Uniforms;
 
 typedef struct Program {
 	void *varyings;
 	void *uniforms;
+	s32 num_varyings;
 } Program;
 
+// "full", "gouraud", "flat" or "depth", false for anything else
+b32 ParseShadingQuality(const char *name, ShadingQuality *quality);
+// how many varyings the rasterizer must interpolate for these uniforms
+s32 NumVaryings(Uniforms *uniforms);
+
 vec4 VertexShader(s32 vertex, void *varyings, void *uniforms);
 vec3 FragmentShader(void *varyings, void *uniforms);
 
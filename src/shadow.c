@@ -0,0 +1,81 @@
+#include "shadow.h"
+#include "scene.h"
+
+void CreateShadowMap(ShadowMap *shadow, s32 size)
+{
+	memset(shadow, 0, sizeof(ShadowMap));
+	shadow->size = size;
+	shadow->depth = (f32 *)malloc(sizeof(f32) * size * size);
+	InitializeCriticalSection(&shadow->lock);
+}
+
+void DestroyShadowMap(ShadowMap *shadow)
+{
+	free(shadow->depth);
+	DeleteCriticalSection(&shadow->lock);
+}
+
+static void RenderShadowMap(ShadowMap *shadow, Model *model, vec3 light)
+{
+	// light directly above would make LookAt's basis degenerate
+	vec3 up = Vec3f(0.0f, 1.0f, 0.0f);
+	if (Vec3Length(Vec3Cross(up, light)) < 1e-4f)
+		up = Vec3f(0.0f, 0.0f, 1.0f);
+
+	// orthographic, w stays 1 so SampleShadow needs no divide
+	mat4 viewport = Viewport(0, 0, shadow->size, shadow->size);
+	shadow->light_mvp = LookAt(light, Vec3f(0.0f, 0.0f, 0.0f), up);
+	shadow->transform = Mat4Multiply(shadow->light_mvp, viewport);
+
+	DepthTarget target;
+	target.depth = shadow->depth;
+	target.width = shadow->size;
+	target.height = shadow->size;
+	target.clip_x0 = 0;
+	target.clip_y0 = 0;
+	target.clip_x1 = shadow->size;
+	target.clip_y1 = shadow->size;
+
+	memset(shadow->depth, 0, sizeof(f32) * shadow->size * shadow->size);
+	DrawModelDepth(&target, model, shadow->light_mvp, viewport);
+
+	shadow->num_renders++;
+}
+
+b32 UpdateShadowMap(ShadowMap *shadow, Model *model, vec3 light)
+{
+	b32 rendered = false;
+
+	if (shadow->valid && shadow->model_generation == model->generation && shadow->light.x == light.x && shadow->light.y == light.y && shadow->light.z == light.z)
+		return false;
+
+	EnterCriticalSection(&shadow->lock);
+	if (!shadow->valid || shadow->model_generation != model->generation || shadow->light.x != light.x || shadow->light.y != light.y || shadow->light.z != light.z) {
+		shadow->valid = false;
+		MemoryBarrier();
+
+		RenderShadowMap(shadow, model, light);
+		shadow->model_generation = model->generation;
+		shadow->light = light;
+
+		// valid is published last, the unlocked check above must not see
+		// it before the depths
+		MemoryBarrier();
+		shadow->valid = true;
+		rendered = true;
+	}
+	LeaveCriticalSection(&shadow->lock);
+
+	return rendered;
+}
+
+f32 SampleShadow(ShadowMap *shadow, vec3 position)
+{
+	vec4 coord = Mat4MultiplyVec4(shadow->transform, Vec4(position, 1.0f));
+	s32 x = (s32)coord.x;
+	s32 y = (s32)coord.y;
+	if (x < 0 || y < 0 || x >= shadow->size || y >= shadow->size)
+		return 1.0f;
+
+	return shadow->depth[y * shadow->size + x] > coord.z + SHADOW_BIAS ? SHADOW_ATTENUATION : 1.0f;
+}
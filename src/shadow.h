@@ -0,0 +1,46 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <windows.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "maths.h"
+
+#include "draw.h"
+#include "model.h"
+
+#define SHADOW_MAP_SIZE 1024
+#define SHADOW_BIAS 1.0f // in depth units, 255 across the light's view
+#define SHADOW_ATTENUATION 0.3f // share of diffuse and specular left in shadow
+
+// depth of the model seen from the light along Scene.light, an
+// orthographic view of the unit cube like the camera's; keyed on the
+// model's generation and the light so a still light and model render it
+// once
+typedef struct ShadowMap {
+	f32 *depth;
+	s32 size;
+
+	mat4 light_mvp;
+	mat4 transform; // model space to shadow map texel and depth
+
+	u32 model_generation;
+	vec3 light;
+	volatile LONG valid;
+
+	CRITICAL_SECTION lock;
+	s32 num_renders;
+} ShadowMap;
+
+void CreateShadowMap(ShadowMap *shadow, s32 size);
+void DestroyShadowMap(ShadowMap *shadow);
+
+// rerenders if the model or light changed, safe to call from several
+// render threads at once; returns true if it rendered
+b32 UpdateShadowMap(ShadowMap *shadow, Model *model, vec3 light);
+
+// 1 where position sees the light, SHADOW_ATTENUATION where it doesn't
+f32 SampleShadow(ShadowMap *shadow, vec3 position);
+
+#endif
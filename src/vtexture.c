@@ -0,0 +1,508 @@
+#include "vtexture.h"
+
+#pragma warning(disable : 4996)
+
+#define VIRTUAL_TEXTURE_MAGIC 0x58455456 // "VTEX"
+#define VIRTUAL_HEADER_SIZE 32
+
+#define PAGE_MASK (VIRTUAL_PAGE_SIZE - 1)
+
+// each level halves the one above, rounding up, until one page holds it
+static s32 ComputeLevels(s32 width, s32 height, VirtualLevel *levels)
+{
+	s32 num_levels = 0;
+	s32 num_pages = 0;
+	for (;;) {
+		VirtualLevel *level = &levels[num_levels++];
+		level->width = width;
+		level->height = height;
+		level->pages_x = (width + PAGE_MASK) >> VIRTUAL_PAGE_SHIFT;
+		level->pages_y = (height + PAGE_MASK) >> VIRTUAL_PAGE_SHIFT;
+		level->first_page = num_pages;
+		num_pages += level->pages_x * level->pages_y;
+
+		if ((width <= VIRTUAL_PAGE_SIZE && height <= VIRTUAL_PAGE_SIZE) || num_levels == MAX_VIRTUAL_LEVELS)
+			break;
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+	return num_levels;
+}
+
+static s64 PageOffset(s64 page, s64 page_size)
+{
+	return VIRTUAL_HEADER_SIZE + page * page_size;
+}
+
+typedef b32 (*RowFunc)(void *data, u8 *row);
+
+// one level of the tiler: a band of rows a page high, and the previous
+// row waiting for its pair to be averaged into the next level
+typedef struct TileLevel {
+	VirtualLevel info;
+	u8 *band;
+	s32 band_rows;
+	s32 band_index;
+	s32 rows_received;
+	u8 *carry;
+	b32 has_carry;
+	u8 *next_row;
+} TileLevel;
+
+typedef struct Tiler {
+	FILE *file;
+	s32 channels;
+	s64 page_size;
+	TileLevel levels[MAX_VIRTUAL_LEVELS];
+	s32 num_levels;
+	u8 *page;
+	b32 ok;
+} Tiler;
+
+// the band goes out as a row of pages, edges padded with the last texel
+static void FlushBand(Tiler *tiler, TileLevel *level)
+{
+	s32 channels = tiler->channels;
+	VirtualLevel *info = &level->info;
+
+	for (s32 px = 0; px < info->pages_x; px++) {
+		for (s32 y = 0; y < VIRTUAL_PAGE_SIZE; y++) {
+			u8 *source = level->band + (s64)min(y, level->band_rows - 1) * info->width * channels;
+			u8 *dest = tiler->page + (s64)y * VIRTUAL_PAGE_SIZE * channels;
+			for (s32 x = 0; x < VIRTUAL_PAGE_SIZE; x++) {
+				s32 source_x = min(px * VIRTUAL_PAGE_SIZE + x, info->width - 1);
+				memcpy(dest + x * channels, source + source_x * channels, channels);
+			}
+		}
+
+		s64 page = info->first_page + level->band_index * info->pages_x + px;
+		tiler->ok = tiler->ok && _fseeki64(tiler->file, PageOffset(page, tiler->page_size), SEEK_SET) == 0 &&
+			fwrite(tiler->page, 1, tiler->page_size, tiler->file) == (size_t)tiler->page_size;
+	}
+
+	level->band_rows = 0;
+	level->band_index++;
+}
+
+static void PushRow(Tiler *tiler, s32 index, u8 *row);
+
+// 2x2 box filter of the carried row and this one into the next level
+static void Downsample(Tiler *tiler, s32 index, u8 *upper, u8 *lower)
+{
+	TileLevel *level = &tiler->levels[index];
+	s32 channels = tiler->channels;
+	s32 width = level->info.width;
+	s32 next_width = tiler->levels[index + 1].info.width;
+
+	for (s32 x = 0; x < next_width; x++) {
+		s32 x0 = 2 * x, x1 = min(2 * x + 1, width - 1);
+		for (s32 c = 0; c < channels; c++) {
+			s32 sum = upper[x0 * channels + c] + upper[x1 * channels + c] + lower[x0 * channels + c] + lower[x1 * channels + c];
+			level->next_row[x * channels + c] = (u8)((sum + 2) / 4);
+		}
+	}
+	PushRow(tiler, index + 1, level->next_row);
+}
+
+static void PushRow(Tiler *tiler, s32 index, u8 *row)
+{
+	TileLevel *level = &tiler->levels[index];
+	s64 row_size = (s64)level->info.width * tiler->channels;
+
+	memcpy(level->band + level->band_rows * row_size, row, row_size);
+	level->band_rows++;
+	level->rows_received++;
+	b32 last = level->rows_received == level->info.height;
+	if (level->band_rows == VIRTUAL_PAGE_SIZE || last)
+		FlushBand(tiler, level);
+
+	if (index + 1 == tiler->num_levels)
+		return;
+	if (level->has_carry) {
+		level->has_carry = false;
+		Downsample(tiler, index, level->carry, row);
+	} else if (last) {
+		// odd height, the last row pairs with itself
+		Downsample(tiler, index, row, row);
+	} else {
+		memcpy(level->carry, row, row_size);
+		level->has_carry = true;
+	}
+}
+
+static b32 TileRows(const char *file_name, s32 width, s32 height, s32 channels, RowFunc read_row, void *data)
+{
+	Tiler tiler;
+	memset(&tiler, 0, sizeof(Tiler));
+
+	VirtualLevel levels[MAX_VIRTUAL_LEVELS];
+	tiler.num_levels = ComputeLevels(width, height, levels);
+	tiler.channels = channels;
+	tiler.page_size = (s64)VIRTUAL_PAGE_SIZE * VIRTUAL_PAGE_SIZE * channels;
+	tiler.file = fopen(file_name, "wb");
+	if (tiler.file == NULL)
+		return false;
+
+	u32 header[VIRTUAL_HEADER_SIZE / sizeof(u32)] = { 0 };
+	header[0] = VIRTUAL_TEXTURE_MAGIC;
+	header[1] = width;
+	header[2] = height;
+	header[3] = channels;
+	header[4] = VIRTUAL_PAGE_SIZE;
+	header[5] = tiler.num_levels;
+	tiler.ok = fwrite(header, 1, sizeof(header), tiler.file) == sizeof(header);
+
+	// a band per level, about twice the top level's band in all
+	for (s32 i = 0; i < tiler.num_levels; i++) {
+		TileLevel *level = &tiler.levels[i];
+		s64 row_size = (s64)levels[i].width * channels;
+		level->info = levels[i];
+		level->band = (u8 *)malloc(row_size * VIRTUAL_PAGE_SIZE);
+		level->carry = (u8 *)malloc(row_size);
+		level->next_row = (u8 *)malloc(row_size);
+	}
+	tiler.page = (u8 *)malloc(tiler.page_size);
+	u8 *row = (u8 *)malloc((s64)width * channels);
+
+	for (s32 y = 0; tiler.ok && y < height; y++) {
+		tiler.ok = read_row(data, row);
+		if (tiler.ok)
+			PushRow(&tiler, 0, row);
+	}
+
+	for (s32 i = 0; i < tiler.num_levels; i++) {
+		free(tiler.levels[i].band);
+		free(tiler.levels[i].carry);
+		free(tiler.levels[i].next_row);
+	}
+	free(tiler.page);
+	free(row);
+
+	tiler.ok = fclose(tiler.file) == 0 && tiler.ok;
+	return tiler.ok;
+}
+
+// rows of a tga as they come off the disk, rle packets may span rows
+typedef struct TGAStream {
+	FILE *file;
+	s32 width, height, channels;
+	b32 rle;
+	s32 packet_left;
+	b32 packet_repeats;
+	u8 pixel[4];
+} TGAStream;
+
+static b32 ReadTGARow(void *data, u8 *row)
+{
+	TGAStream *stream = (TGAStream *)data;
+	s32 channels = stream->channels;
+	if (!stream->rle)
+		return fread(row, 1, (size_t)stream->width * channels, stream->file) == (size_t)stream->width * channels;
+
+	for (s32 x = 0; x < stream->width; x++) {
+		if (stream->packet_left == 0) {
+			s32 header = fgetc(stream->file);
+			if (header == EOF)
+				return false;
+			stream->packet_repeats = (header & 0x80) != 0;
+			stream->packet_left = (header & 0x7F) + 1;
+			if (stream->packet_repeats && fread(stream->pixel, 1, channels, stream->file) != (size_t)channels)
+				return false;
+		}
+		if (!stream->packet_repeats && fread(stream->pixel, 1, channels, stream->file) != (size_t)channels)
+			return false;
+		memcpy(row + x * channels, stream->pixel, channels);
+		stream->packet_left--;
+	}
+	return true;
+}
+
+b32 TileTexture(const char *tga_file, const char *file_name)
+{
+	TGAStream stream;
+	memset(&stream, 0, sizeof(TGAStream));
+	stream.file = fopen(tga_file, "rb");
+	if (stream.file == NULL)
+		return false;
+
+	u8 header[18];
+	b32 ok = fread(header, 1, sizeof(header), stream.file) == sizeof(header);
+	s32 image_type = header[2];
+	stream.width = header[12] + (header[13] << 8);
+	stream.height = header[14] + (header[15] << 8);
+	stream.channels = header[16] >> 3;
+	stream.rle = image_type == 10 || image_type == 11;
+
+	// rows stay in file order, as ReadFromTGA leaves them
+	ok = ok && stream.width > 0 && stream.height > 0 &&
+		(stream.channels == 1 || stream.channels == 3 || stream.channels == 4) &&
+		(image_type == 2 || image_type == 3 || stream.rle) &&
+		_fseeki64(stream.file, header[0], SEEK_CUR) == 0;
+	ok = ok && TileRows(file_name, stream.width, stream.height, stream.channels, ReadTGARow, &stream);
+
+	fclose(stream.file);
+	return ok;
+}
+
+typedef struct ImageRows {
+	Image *image;
+	s32 y;
+} ImageRows;
+
+static b32 ReadImageRow(void *data, u8 *row)
+{
+	ImageRows *rows = (ImageRows *)data;
+	Image *image = rows->image;
+	s64 row_size = (s64)image->width * image->channels;
+	memcpy(row, image->buffer + rows->y++ * row_size, row_size);
+	return true;
+}
+
+b32 TileImage(Image *image, const char *file_name)
+{
+	assert(image->compression == TEXTURE_UNCOMPRESSED && image->format == TEXTURE_FORMAT_BGR8 && !image->virtual_texture);
+
+	ImageRows rows = { image, 0 };
+	return TileRows(file_name, image->width, image->height, image->channels, ReadImageRow, &rows);
+}
+
+static b32 ReadPage(VirtualTexture *texture, s32 page, u8 *texels)
+{
+	EnterCriticalSection(&texture->file_lock);
+	b32 ok = _fseeki64(texture->file, PageOffset(page, texture->page_size), SEEK_SET) == 0 &&
+		fread(texels, 1, texture->page_size, texture->file) == (size_t)texture->page_size;
+	LeaveCriticalSection(&texture->file_lock);
+	return ok;
+}
+
+static void LoadPageJob(void *data, s32 worker)
+{
+	PageLoad *load = (PageLoad *)data;
+	VirtualTexture *texture = load->texture;
+	load->ok = ReadPage(texture, load->page, load->texels);
+
+	EnterCriticalSection(&texture->lock);
+	load->next = texture->completed_loads;
+	texture->completed_loads = load;
+	LeaveCriticalSection(&texture->lock);
+}
+
+// the flag keeps a page from being asked for twice; with every load in
+// use the request is dropped and made again by a later sample
+static void RequestPage(VirtualTexture *texture, s32 page)
+{
+	if (texture->page_requested[page] || InterlockedCompareExchange(&texture->page_requested[page], 1, 0) != 0)
+		return;
+
+	EnterCriticalSection(&texture->lock);
+	PageLoad *load = texture->free_loads;
+	if (load) {
+		texture->free_loads = load->next;
+		texture->num_free_loads--;
+		texture->pages_requested++;
+	}
+	LeaveCriticalSection(&texture->lock);
+
+	if (!load) {
+		texture->page_requested[page] = 0;
+		return;
+	}
+
+	load->page = page;
+	if (texture->jobs)
+		RunJob(texture->jobs, CreateJob(texture->jobs, LoadPageJob, load));
+	else
+		LoadPageJob(load, -1);
+}
+
+// least recently sampled unpinned slot, or a slot never used
+static s32 ClaimSlot(VirtualTexture *texture)
+{
+	s32 victim = -1;
+	for (s32 slot = texture->num_pinned; slot < texture->num_slots; slot++) {
+		if (texture->slot_pages[slot] < 0)
+			return slot;
+		if (victim < 0 || texture->slot_last_used[slot] < texture->slot_last_used[victim])
+			victim = slot;
+	}
+
+	s32 evicted = texture->slot_pages[victim];
+	texture->page_slots[evicted] = -1;
+	texture->page_requested[evicted] = 0;
+	texture->pages_evicted++;
+	return victim;
+}
+
+static void CommitPage(VirtualTexture *texture, s32 slot, s32 page, u8 *texels)
+{
+	memcpy(texture->slots + slot * texture->page_size, texels, texture->page_size);
+	texture->slot_pages[slot] = page;
+	texture->slot_last_used[slot] = texture->frame;
+	texture->page_slots[page] = slot;
+	texture->pages_loaded++;
+}
+
+b32 OpenVirtualTexture(VirtualTexture *texture, const char *file_name, JobSystem *jobs)
+{
+	memset(texture, 0, sizeof(VirtualTexture));
+	texture->file = fopen(file_name, "rb");
+	if (texture->file == NULL)
+		return false;
+
+	u32 header[VIRTUAL_HEADER_SIZE / sizeof(u32)];
+	if (fread(header, 1, sizeof(header), texture->file) != sizeof(header) ||
+		header[0] != VIRTUAL_TEXTURE_MAGIC || header[4] != VIRTUAL_PAGE_SIZE ||
+		header[1] == 0 || header[1] > 65535 || header[2] == 0 || header[2] > 65535 ||
+		(header[3] != 1 && header[3] != 3 && header[3] != 4) ||
+		ComputeLevels(header[1], header[2], texture->levels) != (s32)header[5]) {
+		fclose(texture->file);
+		return false;
+	}
+
+	texture->jobs = jobs;
+	texture->width = header[1];
+	texture->height = header[2];
+	texture->channels = header[3];
+	texture->num_levels = header[5];
+	texture->page_size = (s64)VIRTUAL_PAGE_SIZE * VIRTUAL_PAGE_SIZE * texture->channels;
+	VirtualLevel *coarsest = &texture->levels[texture->num_levels - 1];
+	texture->num_pages = coarsest->first_page + coarsest->pages_x * coarsest->pages_y;
+
+	texture->page_slots = (s32 *)malloc(sizeof(s32) * texture->num_pages);
+	texture->page_requested = (volatile LONG *)calloc(texture->num_pages, sizeof(LONG));
+	for (s32 i = 0; i < texture->num_pages; i++)
+		texture->page_slots[i] = -1;
+
+	texture->num_pinned = coarsest->pages_x * coarsest->pages_y;
+	texture->num_slots = max(VIRTUAL_CACHE_PAGES, texture->num_pinned + 1);
+	texture->slots = (u8 *)malloc(texture->num_slots * texture->page_size);
+	texture->slot_pages = (s32 *)malloc(sizeof(s32) * texture->num_slots);
+	texture->slot_last_used = (s64 *)calloc(texture->num_slots, sizeof(s64));
+	for (s32 i = 0; i < texture->num_slots; i++)
+		texture->slot_pages[i] = -1;
+
+	InitializeCriticalSection(&texture->file_lock);
+	InitializeCriticalSection(&texture->lock);
+	for (s32 i = 0; i < MAX_PENDING_PAGES; i++) {
+		PageLoad *load = &texture->loads[i];
+		load->texture = texture;
+		load->texels = (u8 *)malloc(texture->page_size);
+		load->next = texture->free_loads;
+		texture->free_loads = load;
+	}
+	texture->num_free_loads = MAX_PENDING_PAGES;
+
+	// the fallback every sample can count on
+	b32 ok = true;
+	for (s32 i = 0; i < texture->num_pinned; i++) {
+		s32 page = coarsest->first_page + i;
+		ok = ok && ReadPage(texture, page, texture->loads[0].texels);
+		CommitPage(texture, i, page, texture->loads[0].texels);
+		texture->page_requested[page] = 1;
+	}
+	if (!ok) {
+		CloseVirtualTexture(texture);
+		return false;
+	}
+
+	// samples go through the same Image as everything else
+	texture->image.width = texture->width;
+	texture->image.height = texture->height;
+	texture->image.channels = texture->channels;
+	texture->image.in_arena = true; // owned by the texture, not FreeImage
+	texture->image.compression = TEXTURE_UNCOMPRESSED;
+	texture->image.format = TEXTURE_FORMAT_BGR8;
+	texture->image.virtual_texture = texture;
+	TouchImage(&texture->image);
+	return true;
+}
+
+void FlushVirtualTexture(VirtualTexture *texture)
+{
+	for (;;) {
+		EnterCriticalSection(&texture->lock);
+		s32 in_flight = MAX_PENDING_PAGES - texture->num_free_loads;
+		for (PageLoad *load = texture->completed_loads; load; load = load->next)
+			in_flight--;
+		LeaveCriticalSection(&texture->lock);
+
+		if (in_flight == 0)
+			break;
+		Sleep(1);
+	}
+}
+
+void CloseVirtualTexture(VirtualTexture *texture)
+{
+	FlushVirtualTexture(texture);
+
+	for (s32 i = 0; i < MAX_PENDING_PAGES; i++)
+		free(texture->loads[i].texels);
+	free(texture->page_slots);
+	free((void *)texture->page_requested);
+	free(texture->slots);
+	free(texture->slot_pages);
+	free(texture->slot_last_used);
+
+	DeleteCriticalSection(&texture->file_lock);
+	DeleteCriticalSection(&texture->lock);
+	fclose(texture->file);
+}
+
+b32 UpdateVirtualTexture(VirtualTexture *texture)
+{
+	EnterCriticalSection(&texture->lock);
+	PageLoad *completed = texture->completed_loads;
+	texture->completed_loads = NULL;
+	LeaveCriticalSection(&texture->lock);
+
+	b32 changed = false;
+	for (PageLoad *load = completed, *next; load; load = next) {
+		next = load->next;
+		// a page that failed to read stays requested, so it is not retried
+		// on every sample
+		if (load->ok) {
+			CommitPage(texture, ClaimSlot(texture), load->page, load->texels);
+			texture->version++;
+			changed = true;
+		}
+
+		EnterCriticalSection(&texture->lock);
+		load->next = texture->free_loads;
+		texture->free_loads = load;
+		texture->num_free_loads++;
+		LeaveCriticalSection(&texture->lock);
+	}
+
+	texture->frame++;
+	return changed || texture->num_free_loads < MAX_PENDING_PAGES;
+}
+
+vec3 SampleVirtualTexture(VirtualTexture *texture, s32 x, s32 y)
+{
+	// every missing level on the way down is asked for, so the coarser
+	// ones arrive first to cover for the rest
+	u8 *texel = NULL;
+	for (s32 level = 0; !texel; level++) {
+		VirtualLevel *info = &texture->levels[level];
+		s32 level_x = x >> level, level_y = y >> level;
+		s32 page = info->first_page + (level_y >> VIRTUAL_PAGE_SHIFT) * info->pages_x + (level_x >> VIRTUAL_PAGE_SHIFT);
+		s32 slot = texture->page_slots[page];
+		if (slot < 0) {
+			RequestPage(texture, page);
+			continue;
+		}
+
+		texture->slot_last_used[slot] = texture->frame;
+		s32 offset = ((level_y & PAGE_MASK) << VIRTUAL_PAGE_SHIFT) + (level_x & PAGE_MASK);
+		texel = texture->slots + slot * texture->page_size + offset * texture->channels;
+		if (level > 0)
+			texture->fallback_samples++;
+	}
+
+	vec3 colour;
+	colour.b = texel[0];
+	colour.g = texture->channels >= 3 ? texel[1] : texel[0];
+	colour.r = texture->channels >= 3 ? texel[2] : texel[0];
+	return colour;
+}
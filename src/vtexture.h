@@ -0,0 +1,97 @@
+#ifndef VTEXTURE_H
+#define VTEXTURE_H
+
+#include <windows.h>
+#include <stdio.h>
+
+#include "types.h"
+#include "maths.h"
+
+#include "image.h"
+#include "jobs.h"
+
+#define VIRTUAL_PAGE_SHIFT 7
+#define VIRTUAL_PAGE_SIZE (1 << VIRTUAL_PAGE_SHIFT) // texels along a page side
+#define VIRTUAL_CACHE_PAGES 512 // resident pages, 24 MB for bgr
+#define MAX_VIRTUAL_LEVELS 16
+#define MAX_PENDING_PAGES 64 // page loads in flight at once
+
+// one mip level of the tiled file, pages in rows from first_page on
+typedef struct VirtualLevel {
+	s32 width, height;
+	s32 pages_x, pages_y;
+	s32 first_page;
+} VirtualLevel;
+
+typedef struct PageLoad {
+	struct VirtualTexture *texture;
+	s32 page;
+	u8 *texels;
+	b32 ok;
+	struct PageLoad *next;
+} PageLoad;
+
+// a texture tiled into pages on disk with a fixed size cache of them in
+// memory. the page table only changes in UpdateVirtualTexture, between
+// frames; a sample whose page is missing asks for it and falls back to
+// the coarser levels, the coarsest of which never leaves memory
+typedef struct VirtualTexture {
+	FILE *file;
+	CRITICAL_SECTION file_lock;
+	JobSystem *jobs; // NULL loads each page as it is asked for
+
+	s32 width, height, channels;
+	VirtualLevel levels[MAX_VIRTUAL_LEVELS];
+	s32 num_levels;
+	s32 num_pages;
+	s64 page_size; // bytes
+
+	s32 *page_slots; // cache slot per page, -1 while not resident
+	volatile LONG *page_requested; // loading or resident
+
+	// cache slots, the first num_pinned hold the coarsest level
+	u8 *slots;
+	s32 *slot_pages;
+	s64 *slot_last_used;
+	s32 num_slots;
+	s32 num_pinned;
+	s64 frame;
+
+	PageLoad loads[MAX_PENDING_PAGES];
+	PageLoad *free_loads;
+	PageLoad *completed_loads;
+	s32 num_free_loads;
+	CRITICAL_SECTION lock;
+
+	// changes whenever the page table does
+	s64 version;
+	// what the shaders sample, SampleTexture sends it here
+	Image image;
+
+	// stats
+	s64 pages_requested;
+	s64 pages_loaded;
+	s64 pages_evicted;
+	s64 fallback_samples;
+} VirtualTexture;
+
+// tiles an uncompressed or rle tga into a page file with every mip level
+// down to one page, reading it a band of rows at a time
+b32 TileTexture(const char *tga_file, const char *file_name);
+// the same from an image already in memory, bgr8 and uncompressed
+b32 TileImage(Image *image, const char *file_name);
+
+// loads the coarsest level, everything else streams in as it is sampled
+b32 OpenVirtualTexture(VirtualTexture *texture, const char *file_name, JobSystem *jobs);
+void CloseVirtualTexture(VirtualTexture *texture);
+
+// commits finished loads into the cache, only while nothing samples the
+// texture; true if that changed it or loads are still in flight
+b32 UpdateVirtualTexture(VirtualTexture *texture);
+// waits for every load in flight, they are committed by the next update
+void FlushVirtualTexture(VirtualTexture *texture);
+
+// texel x, y of the finest resident level covering it, 0-255 rgb
+vec3 SampleVirtualTexture(VirtualTexture *texture, s32 x, s32 y);
+
+#endif
@@ -4,6 +4,90 @@
 #include "image.h"
 #include "model.h"
 #include "draw.h"
+#include "scene.h"
+#include "harness.h"
+#include "writer.h"
+#include "reorder.h"
+#include "incremental.h"
+#include "compress.h"
+#include "assets.h"
+#include "resolution.h"
+#include "server.h"
+#include "cluster.h"
+
+void CreateBackbuffer(Backbuffer *buffer, s32 width, s32 height)
+{
+	buffer->width = width;
+	buffer->height = height;
+
+	s32 size = width * height * sizeof(s32);
+
+	buffer->memory = VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	buffer->bitmapInfo.bmiHeader.biSize = sizeof(buffer->bitmapInfo.bmiHeader);
+	buffer->bitmapInfo.bmiHeader.biWidth = width;
+	buffer->bitmapInfo.bmiHeader.biHeight = height;
+	buffer->bitmapInfo.bmiHeader.biPlanes = 1;
+	buffer->bitmapInfo.bmiHeader.biBitCount = 32;
+	buffer->bitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+	buffer->zbuffer = VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+	ResetClipRect(buffer);
+	buffer->depth_test = DEPTH_TEST_GREATER;
+
+	CreateArena(&buffer->scratch, FRAME_ARENA_SIZE + (size_t)width * height * FRAME_SCRATCH_PER_PIXEL);
+}
+
+void FreeBackbuffer(Backbuffer *buffer)
+{
+	if (buffer->memory)
+		VirtualFree(buffer->memory, 0, MEM_RELEASE);
+	if (buffer->zbuffer)
+		VirtualFree(buffer->zbuffer, 0, MEM_RELEASE);
+	buffer->memory = NULL;
+	buffer->zbuffer = NULL;
+	FreeArena(&buffer->scratch);
+}
+
+void ClearBackbuffer(Backbuffer *buffer)
+{
+	// Clear backbuffer
+	memset(buffer->memory, 0, (s64)buffer->width * (s64)buffer->height * sizeof(s32));
+	// Clear zbuffer
+	memset(buffer->zbuffer, 0, (s64)buffer->width * (s64)buffer->height * sizeof(f32));
+	// Start a new frame of scratch
+	ResetArena(&buffer->scratch);
+}
+
+void SetClipRect(Backbuffer *buffer, s32 x0, s32 y0, s32 x1, s32 y1)
+{
+	buffer->clip_x0 = max(0, x0);
+	buffer->clip_y0 = max(0, y0);
+	buffer->clip_x1 = min(buffer->width, x1);
+	buffer->clip_y1 = min(buffer->height, y1);
+}
+
+void ResetClipRect(Backbuffer *buffer)
+{
+	SetClipRect(buffer, 0, 0, buffer->width, buffer->height);
+}
+
+static void PresentBackbuffer(Backbuffer *buffer, s64 frame, void *user_data)
+{
+	HDC device_context = (HDC)user_data;
+
+	StretchDIBits(device_context, 
+		0, 0, 
+		buffer->width, buffer->height, 
+		0, 0, 
+		buffer->width, buffer->height, 
+		buffer->memory, 
+		&buffer->bitmapInfo, 
+		DIB_RGB_COLORS, 
+		SRCCOPY
+	);
+}
 
 static LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -20,31 +104,21 @@ static LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wParam, LPA
 		{
 			RECT rect;
 			GetClientRect(window, &rect);
-			platform.backbuffer.width = rect.right - rect.left;
-			platform.backbuffer.height = rect.bottom - rect.top;
-
-			s32 size = platform.backbuffer.width * platform.backbuffer.height * sizeof(s32);
-
-			if (platform.backbuffer.memory)
-				VirtualFree(platform.backbuffer.memory, 0, MEM_RELEASE);
-			
-			platform.backbuffer.memory = VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-
-			platform.backbuffer.bitmapInfo.bmiHeader.biSize = sizeof(platform.backbuffer.bitmapInfo.bmiHeader);
-			platform.backbuffer.bitmapInfo.bmiHeader.biWidth = platform.backbuffer.width;
-			platform.backbuffer.bitmapInfo.bmiHeader.biHeight = platform.backbuffer.height;
-			platform.backbuffer.bitmapInfo.bmiHeader.biPlanes = 1;
-			platform.backbuffer.bitmapInfo.bmiHeader.biBitCount = 32;
-			platform.backbuffer.bitmapInfo.bmiHeader.biCompression = BI_RGB;
-
-			if (platform.backbuffer.zbuffer)
-				VirtualFree(platform.backbuffer.zbuffer, 0, MEM_RELEASE);
-
-			platform.backbuffer.zbuffer = VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			platform.width = rect.right - rect.left;
+			platform.height = rect.bottom - rect.top;
 
-			platform.viewport = Viewport(0, 0, platform.backbuffer.width, platform.backbuffer.height);
+			// first WM_SIZE arrives before the ring exists
+			if (platform.frames.num_buffers)
+				ResizeFrameRing(&platform.frames, platform.width, platform.height);
 
 		} break;
+		case WM_PAINT:
+		{
+			PAINTSTRUCT paint;
+			BeginPaint(window, &paint);
+			EndPaint(window, &paint);
+			platform.repaint = true;
+		} break;
 		default:
 			result = DefWindowProc(window, message, wParam, lParam);
 		}
@@ -52,8 +126,265 @@ static LRESULT CALLBACK WindowProc(HWND window, UINT message, WPARAM wParam, LPA
 }
 
 
+static RenderCluster cluster;
+
+// rendered here instead when the cluster can't take the frame
+static void RenderOnCluster(Backbuffer *buffer, Scene *scene, Camera *camera)
+{
+	if (!RenderClusterFrame(&cluster, buffer, scene, camera))
+		RenderScene(buffer, scene, camera);
+}
+
+// the page file next to a tga map
+static void PagedMapName(char *file_name, size_t size, const char *tga_file)
+{
+	snprintf(file_name, size, "%.*s.vtex", (s32)(strrchr(tga_file, '.') - tga_file), tga_file);
+}
+
+// opens the page file next to a tga map, tiling it first if there is none
+// or the tga has been written since
+static b32 OpenPagedMap(VirtualTexture *texture, const char *tga_file, JobSystem *jobs)
+{
+	char file_name[MAX_PATH];
+	PagedMapName(file_name, sizeof(file_name), tga_file);
+
+	WIN32_FILE_ATTRIBUTE_DATA source, paged;
+	b32 stale = !GetFileAttributesExA(file_name, GetFileExInfoStandard, &paged) ||
+		(GetFileAttributesExA(tga_file, GetFileExInfoStandard, &source) &&
+		CompareFileTime(&paged.ftLastWriteTime, &source.ftLastWriteTime) < 0);
+	if (!stale && OpenVirtualTexture(texture, file_name, jobs))
+		return true;
+	return TileTexture(tga_file, file_name) && OpenVirtualTexture(texture, file_name, jobs);
+}
+
+// the workers go down with the maps, they only stayed up for their pages
+static void ClosePagedMaps(VirtualTexture *textures, s32 count, JobSystem *jobs)
+{
+	if (!count)
+		return;
+	for (s32 i = 0; i < count; i++)
+		CloseVirtualTexture(&textures[i]);
+	DestroyJobSystem(jobs);
+}
+
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd)
 {
+	// renderer.exe --serve <socket path> renders for other processes until
+	// one sends quit, with the assets they name kept loaded; see server.h
+	char socket_path[MAX_ASSET_PATH];
+	if (sscanf(lpCmdLine, "--serve %259s", socket_path) == 1) {
+		JobSystem jobs;
+		CreateJobSystem(&jobs, 0, 0);
+		RenderServer server;
+		b32 started = StartRenderServer(&server, socket_path, &jobs);
+		if (started) {
+			RunRenderServer(&server);
+			DestroyRenderServer(&server);
+		}
+		DestroyJobSystem(&jobs);
+		return started ? 0 : 1;
+	}
+
+	// renderer.exe --cluster-worker <name> <index> renders a band of every
+	// frame for the --cluster process that started it; see cluster.h
+	char cluster_name[64];
+	s32 worker_index;
+	if (sscanf(lpCmdLine, "--cluster-worker %63s %d", cluster_name, &worker_index) == 2)
+		return RunClusterWorker(cluster_name, worker_index);
+
+	Scene scene;
+	memset(&scene, 0, sizeof(Scene));
+	CreateArena(&scene.arena, (size_t)1024 * 1024 * 1024);
+	scene.light = Vec3f(1.0f, 1.0f, 1.0f);
+
+	// --typed-maps after any other option decodes the normal map to unit
+	// snorm8 normals and keeps the specular map as a single channel
+	b32 typed_maps = strstr(lpCmdLine, "--typed-maps") != NULL;
+	TextureFormat normal_format = typed_maps ? TEXTURE_FORMAT_SNORM8X4 : TEXTURE_FORMAT_BGR8;
+	TextureFormat specular_format = typed_maps ? TEXTURE_FORMAT_R8 : TEXTURE_FORMAT_BGR8;
+
+	// --compress-textures after any other option keeps the bgr8 maps as
+	// 4x4 blocks, decoded as they are sampled
+	b32 compress = strstr(lpCmdLine, "--compress-textures") != NULL;
+	TextureCompression colour_compression = compress ? TEXTURE_BC1 : TEXTURE_UNCOMPRESSED;
+	TextureCompression normal_compression = compress ? TEXTURE_BC3 : TEXTURE_UNCOMPRESSED;
+
+	// --virtual-textures after any other option streams the maps in pages
+	// from a .vtex file next to each, tiled from the tga on first use; the
+	// workers stay up to load pages as frames ask for them
+	b32 virtual_textures = strstr(lpCmdLine, "--virtual-textures") != NULL;
+	const char *model_file = "assets/african_head.obj";
+	const char *map_files[3] = { "assets/african_head_diffuse.tga", "assets/african_head_nm.tga", "assets/african_head_spec.tga" };
+	VirtualTexture virtual_maps[3];
+
+	// the model and maps are read, decoded and converted side by side on
+	// the workers, each fetch only waits for its own asset
+	JobSystem jobs;
+	CreateJobSystem(&jobs, 0, 0);
+	for (s32 i = 0; virtual_textures && i < 3; i++) {
+		if (!OpenPagedMap(&virtual_maps[i], map_files[i], &jobs)) {
+			ClosePagedMaps(virtual_maps, i, &jobs);
+			return 1;
+		}
+	}
+
+	AssetLoader loader;
+	CreateAssetLoader(&loader, &jobs);
+
+	Asset *model = LoadModelAsync(&loader, model_file);
+	if (virtual_textures) {
+		scene.diffuse_map = &virtual_maps[0].image;
+		scene.normal_map = &virtual_maps[1].image;
+		scene.specular_map = &virtual_maps[2].image;
+	} else {
+		Asset *diffuse_map = LoadTextureAsync(&loader, map_files[0], TEXTURE_FORMAT_BGR8, colour_compression);
+		Asset *normal_map = LoadTextureAsync(&loader, map_files[1], normal_format, normal_compression);
+		Asset *specular_map = LoadTextureAsync(&loader, map_files[2], specular_format, colour_compression);
+		scene.diffuse_map = GetTexture(&loader, diffuse_map);
+		scene.normal_map = GetTexture(&loader, normal_map);
+		scene.specular_map = GetTexture(&loader, specular_map);
+	}
+	scene.model = GetModel(&loader, model);
+
+	DestroyAssetLoader(&loader);
+	if (!virtual_textures)
+		DestroyJobSystem(&jobs);
+
+	// a missing or bad asset ends the run with every file that failed named
+	Image *maps[3] = { scene.diffuse_map, scene.normal_map, scene.specular_map };
+	b32 loaded = scene.model != NULL;
+	if (!scene.model)
+		printf("could not load %s\n", model_file);
+	for (s32 i = 0; i < 3; i++) {
+		if (!maps[i])
+			printf("could not load %s\n", map_files[i]);
+		loaded = loaded && maps[i];
+	}
+	if (!loaded) {
+		ClosePagedMaps(virtual_maps, virtual_textures ? 3 : 0, &jobs);
+		FreeScene(&scene);
+		return 1;
+	}
+
+	// --bake-lighting after any other option decodes the maps once up front,
+	// which streamed maps are meant to avoid
+	LightingCache lighting_cache;
+	scene.lighting_cache = NULL;
+	if (strstr(lpCmdLine, "--bake-lighting") && !virtual_textures) {
+		CreateLightingCache(&lighting_cache);
+		scene.lighting_cache = &lighting_cache;
+	}
+
+	// --shadows after any other option attenuates what the model hides
+	// from the light
+	ShadowMap shadow_map;
+	scene.shadow_map = NULL;
+	if (strstr(lpCmdLine, "--shadows")) {
+		CreateShadowMap(&shadow_map, SHADOW_MAP_SIZE);
+		scene.shadow_map = &shadow_map;
+	}
+
+	// --wireframe after any other option draws unique edges and debug
+	// overlays instead of shading
+	WireMesh wireframe;
+	scene.wireframe = NULL;
+	if (strstr(lpCmdLine, "--wireframe")) {
+		BuildWireMesh(&wireframe, scene.model, &scene.arena);
+		scene.wireframe = &wireframe;
+	}
+
+	// --quality full|gouraud|flat|depth trades shading for speed, for
+	// previews and thumbnails
+	scene.quality = SHADING_FULL;
+	char *quality = strstr(lpCmdLine, "--quality ");
+	if (quality)
+		ParseShadingQuality(quality + strlen("--quality "), &scene.quality);
+
+	// --optimize-mesh after any other option reorders faces for the vertex
+	// cache, --optimize-mesh overdraw then also sorts the clusters front to
+	// back
+	char *optimize = strstr(lpCmdLine, "--optimize-mesh");
+	b32 sort_clusters = optimize && strncmp(optimize, "--optimize-mesh overdraw", 24) == 0;
+	if (optimize) {
+		ReorderStats stats;
+		scene.model = ReorderModel(scene.model, sort_clusters, &stats, &scene.arena);
+		printf("acmr %.3f -> %.3f, overdraw %.3f -> %.3f, %d clusters\n",
+			stats.acmr_before, stats.acmr_after, stats.overdraw_before, stats.overdraw_after, stats.num_clusters);
+	}
+
+	// how --cluster workers load their own copies of the scene, here and in
+	// the harness
+	ClusterAssets cluster_assets;
+	memset(&cluster_assets, 0, sizeof(ClusterAssets));
+	strncpy(cluster_assets.model_path, model_file, MAX_ASSET_PATH - 1);
+	for (s32 i = 0; i < 3; i++) {
+		if (virtual_textures)
+			PagedMapName(cluster_assets.map_paths[i], MAX_ASSET_PATH, map_files[i]);
+		else
+			strncpy(cluster_assets.map_paths[i], map_files[i], MAX_ASSET_PATH - 1);
+		cluster_assets.map_formats[i] = maps[i]->format;
+		cluster_assets.map_compressions[i] = maps[i]->compression;
+	}
+	cluster_assets.virtual_maps = virtual_textures;
+	cluster_assets.reorder = optimize != NULL;
+	cluster_assets.sort_clusters = sort_clusters;
+
+	// renderer.exe --compare [output_dir]
+	if (strncmp(lpCmdLine, "--compare", 9) == 0) {
+		const char *output_dir = lpCmdLine[9] == ' ' ? lpCmdLine + 10 : ".";
+		s32 failures = RunHarness(&scene, &cluster_assets, 800, 800, output_dir);
+		ClosePagedMaps(virtual_maps, virtual_textures ? 3 : 0, &jobs);
+		FreeScene(&scene);
+		return failures;
+	}
+
+	// --msaa renders recorded and dynamic resolution frames with 4x msaa,
+	// --z-prepass lays down depth first so each pixel shades once
+	// --cluster <workers> splits those frames into bands of rows rendered by
+	// that many worker processes, which load the same assets themselves
+	RenderFunc render = RenderScene;
+	char *cluster_workers = strstr(lpCmdLine, "--cluster ");
+	s32 num_workers;
+	if (scene.wireframe)
+		render = RenderWireframe;
+	else if (cluster_workers && sscanf(cluster_workers, "--cluster %d", &num_workers) == 1 &&
+		StartRenderCluster(&cluster, min(max(num_workers, 1), MAX_CLUSTER_WORKERS), &cluster_assets))
+		render = RenderOnCluster;
+	else if (strstr(lpCmdLine, "--msaa"))
+		render = RenderSceneMultisample;
+	else if (strstr(lpCmdLine, "--z-prepass"))
+		render = RenderScenePrepass;
+
+	vec3 centre = Vec3f(0.0f, 0.0f, 0.0f);
+	vec3 up = Vec3f(0.0f, 1.0f, 0.0f);
+
+	// renderer.exe --record <frames> <path>, path is a pattern like out%04d.png or - for stdout
+	s32 num_frames;
+	char output_path[512];
+	if (sscanf(lpCmdLine, "--record %d %511s", &num_frames, output_path) == 2) {
+		ImageWriter writer;
+		OpenImageWriter(&writer, output_path, ImageFormatFromPath(output_path));
+
+		// encoding frame N overlaps rendering frame N+1
+		FrameRing frames;
+		CreateFrameRing(&frames, 3, 800, 800, PresentToWriter, &writer);
+		for (s32 i = 0; i < num_frames; i++) {
+			f32 angle = 2.0f * 3.14159265f * i / num_frames;
+			Camera camera = MakeCamera(Vec3f(3.0f * sinf(angle), 1.0f, 3.0f * cosf(angle)), centre, up);
+			Backbuffer *buffer = AcquireFrame(&frames);
+			render(buffer, &scene, &camera);
+			SubmitFrame(&frames);
+		}
+		DestroyFrameRing(&frames);
+		CloseImageWriter(&writer);
+
+		if (render == RenderOnCluster)
+			StopRenderCluster(&cluster);
+		ClosePagedMaps(virtual_maps, virtual_textures ? 3 : 0, &jobs);
+		FreeScene(&scene);
+		return 0;
+	}
+
 	platform.running = true;
 	
 	WNDCLASS window_class = {0};
@@ -86,33 +417,28 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 
 	HDC device_context = GetDC(window);
 
-	Model *model = LoadModel("assets/african_head.obj");
-	Image *diffuse_map = ReadFromTGA("assets/african_head_diffuse.tga");
-	Image *normal_map = ReadFromTGA("assets/african_head_nm.tga");
-	Image *specular_map = ReadFromTGA("assets/african_head_spec.tga");
+	CreateFrameRing(&platform.frames, 2, platform.width, platform.height, PresentBackbuffer, device_context);
 
 	vec3 eye = Vec3f(1.0f, 1.0f, 3.0f);
-	vec3 centre = Vec3f(0.0f, 0.0f, 0.0f);
-	vec3 up = Vec3f(0.0f, 1.0f, 0.0f);
+	Camera camera = MakeCamera(eye, centre, up);
+
+	// --dynamic-resolution <ms> trades resolution for a frame time budget
+	DynamicResolution resolution;
+	f32 target_ms = 0.0f;
+	char *budget = strstr(lpCmdLine, "--dynamic-resolution");
+	b32 dynamic_resolution = budget && sscanf(budget, "--dynamic-resolution %f", &target_ms) == 1 && target_ms > 0.0f;
+	CreateDynamicResolution(&resolution, target_ms);
+
+	IncrementalRenderer incremental;
+	CreateIncrementalRenderer(&incremental, platform.width, platform.height);
+	SceneObject object;
+	object.model = scene.model;
+	object.transform = Mat4(1.0f);
+	object.version = 0;
 
-	mat4 model_view = LookAt(eye, centre, up);
-	f32 coeff = -1.0f / Vec3Length(Vec3Minus(centre, eye));
-	mat4 projection = Projection(coeff);
-	mat4 mvp = Mat4Multiply(projection, model_view);
-	mat4 mvp_inverse = Mat4InverseTranspose(mvp);
-
-	vec3 light = Vec3f(1.0f, 1.0f, 1.0f);
-
-	Varyings varyings;
-	Uniforms uniforms;
-	platform.program.varyings = &varyings;
-	platform.program.uniforms = &uniforms;
-	uniforms.mvp = mvp;
-	uniforms.mvp_inverse = mvp_inverse;
-	uniforms.light = light;
-	uniforms.diffuse_map = diffuse_map;
-	uniforms.normal_map = normal_map;
-	uniforms.specular_map = specular_map;
+	// what the last wireframe or cluster frame was drawn for
+	Camera drawn_camera = { 0 };
+	s32 drawn_width = 0, drawn_height = 0;
 	
 	while (platform.running) {
 		MSG message;
@@ -121,34 +447,67 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
 			DispatchMessage(&message);
 		}
 
-		// Clear backbuffer
-		memset(platform.backbuffer.memory, 0, (s64)platform.backbuffer.width * (s64)platform.backbuffer.height * sizeof(s32));
-		// Clear zbuffer
-		memset(platform.backbuffer.zbuffer, 0, (s64)platform.backbuffer.width * (s64)platform.backbuffer.height * sizeof(f32));
+		// pages the last frame asked for go in before this one samples
+		b32 streaming = UpdateSceneTextures(&scene);
 
-		for (s32 i = 0; i < model->num_faces; i++) {
-			for (s32 j = 0; j < 3; j++) {
-				varyings.in_positions[j] = model->positions[i * 3 + j];
-				varyings.in_texcoords[j] = model->texcoords[i * 3 + j];
+		// wireframe and cluster frames are redrawn only when the camera, the
+		// window size or its contents changed, and sleep on messages
+		// otherwise; the cluster rebalances its bands from each frame it
+		// renders, so it only settles while frames are being produced
+		if (render == RenderWireframe || render == RenderOnCluster) {
+			b32 changed = platform.repaint || platform.width != drawn_width || platform.height != drawn_height ||
+				memcmp(&camera, &drawn_camera, sizeof(Camera)) != 0;
+			if (!changed) {
+				WaitMessage();
+				continue;
 			}
-			Draw(&platform.backbuffer, &platform.program, platform.viewport);
+			platform.repaint = false;
+			drawn_camera = camera;
+			drawn_width = platform.width;
+			drawn_height = platform.height;
+
+			Backbuffer *buffer = AcquireFrame(&platform.frames);
+			render(buffer, &scene, &camera);
+			SubmitFrame(&platform.frames);
+			continue;
+		}
+
+		// with a frame budget every frame renders at the scale that fits it
+		if (dynamic_resolution) {
+			Backbuffer *buffer = AcquireFrame(&platform.frames);
+			Backbuffer *internal = BeginScaledFrame(&resolution, buffer->width, buffer->height);
+			render(internal, &scene, &camera);
+			EndScaledFrame(&resolution, buffer);
+			SubmitFrame(&platform.frames);
+			continue;
 		}
 
-		StretchDIBits(device_context, 
-			0, 0, 
-			platform.backbuffer.width, platform.backbuffer.height, 
-			0, 0, 
-			platform.backbuffer.width, platform.backbuffer.height, 
-			platform.backbuffer.memory, 
-			&platform.backbuffer.bitmapInfo, 
-			DIB_RGB_COLORS, 
-			SRCCOPY
-		);
+		// an unchanged frame is neither rendered nor presented, the loop
+		// sleeps until the next message instead
+		FrameUpdate update = RenderIncremental(&incremental, &scene, &camera, &object, 1, platform.width, platform.height);
+		if (update == FRAME_UNCHANGED && !platform.repaint) {
+			// pages still streaming in change the frame without a message
+			if (streaming)
+				Sleep(1);
+			else
+				WaitMessage();
+			continue;
+		}
+		platform.repaint = false;
+
+		// frame N is presented on the ring's thread while N+1 renders here
+		Backbuffer *buffer = AcquireFrame(&platform.frames);
+		CopyBackbuffer(buffer, &incremental.canvas);
+		SubmitFrame(&platform.frames);
 	}
 
-	FreeModel(model);
-	FreeImage(diffuse_map);
-	FreeImage(normal_map);
-	FreeImage(specular_map);
+	DestroyIncrementalRenderer(&incremental);
+	DestroyDynamicResolution(&resolution);
+	DestroyFrameRing(&platform.frames);
+
+	if (render == RenderOnCluster)
+		StopRenderCluster(&cluster);
+	ClosePagedMaps(virtual_maps, virtual_textures ? 3 : 0, &jobs);
+	FreeScene(&scene);
 	return 0;
 }
\ No newline at end of file
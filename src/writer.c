@@ -0,0 +1,489 @@
+#include "writer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <io.h>
+
+#pragma warning(disable : 4996)
+
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+static u32 crc_table[8][256];
+static u16 literal_codes[288];
+static u8 literal_lengths[288];
+static u8 length_symbols[259];
+
+static const u16 length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const u8 length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static u32 ReverseBits(u32 code, s32 length)
+{
+	u32 result = 0;
+	for (s32 i = 0; i < length; i++) {
+		result = (result << 1) | (code & 1);
+		code >>= 1;
+	}
+	return result;
+}
+
+// tables are deterministic, so threads racing to build them write the same values
+static void InitTables(void)
+{
+	static volatile LONG initialised;
+	if (initialised)
+		return;
+
+	for (u32 i = 0; i < 256; i++) {
+		u32 c = i;
+		for (s32 k = 0; k < 8; k++)
+			c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		crc_table[0][i] = c;
+	}
+	// slicing-by-8 tables
+	for (u32 i = 0; i < 256; i++) {
+		for (s32 k = 1; k < 8; k++)
+			crc_table[k][i] = crc_table[0][crc_table[k - 1][i] & 0xFF] ^ (crc_table[k - 1][i] >> 8);
+	}
+
+	// fixed huffman literal/length codes (rfc 1951 3.2.6)
+	for (s32 i = 0; i < 288; i++) {
+		u32 code, length;
+		if (i < 144) {
+			code = 0x30 + i;
+			length = 8;
+		} else if (i < 256) {
+			code = 0x190 + (i - 144);
+			length = 9;
+		} else if (i < 280) {
+			code = i - 256;
+			length = 7;
+		} else {
+			code = 0xC0 + (i - 280);
+			length = 8;
+		}
+		literal_codes[i] = (u16)ReverseBits(code, length);
+		literal_lengths[i] = (u8)length;
+	}
+
+	for (s32 length = 3, i = 0; length <= 258; length++) {
+		while (i < 28 && length >= length_base[i + 1])
+			i++;
+		length_symbols[length] = (u8)i;
+	}
+
+	InterlockedExchange(&initialised, 1);
+}
+
+static u32 UpdateCRC(u32 crc, u8 *data, s64 size)
+{
+	crc = ~crc;
+	while (size >= 8) {
+		u32 low = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((u32)data[3] << 24));
+		u32 high = data[4] | (data[5] << 8) | (data[6] << 16) | ((u32)data[7] << 24);
+		crc = crc_table[7][low & 0xFF] ^ crc_table[6][(low >> 8) & 0xFF] ^
+			crc_table[5][(low >> 16) & 0xFF] ^ crc_table[4][low >> 24] ^
+			crc_table[3][high & 0xFF] ^ crc_table[2][(high >> 8) & 0xFF] ^
+			crc_table[1][(high >> 16) & 0xFF] ^ crc_table[0][high >> 24];
+		data += 8;
+		size -= 8;
+	}
+	for (s64 i = 0; i < size; i++)
+		crc = crc_table[0][(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static u32 UpdateAdler(u32 adler, u8 *data, s64 size)
+{
+	u32 a = adler & 0xFFFF;
+	u32 b = adler >> 16;
+	while (size > 0) {
+		// largest block before b can overflow 32 bits
+		s64 block = min(size, 5552);
+		for (s64 i = 0; i < block; i++) {
+			a += data[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += block;
+		size -= block;
+	}
+	return (b << 16) | a;
+}
+
+// where the encoders put their bytes, a file or a malloc block that grows
+// as needed
+typedef struct OutputStream {
+	FILE *file;
+	u8 *memory;
+	s64 size;
+	s64 capacity;
+} OutputStream;
+
+static b32 Put(OutputStream *stream, const void *data, size_t size)
+{
+	if (stream->file)
+		return fwrite(data, 1, size, stream->file) == size;
+	if (size == 0)
+		return true;
+
+	if (stream->size + (s64)size > stream->capacity) {
+		s64 capacity = max(stream->capacity * 2, stream->size + (s64)size);
+		u8 *memory = (u8 *)realloc(stream->memory, capacity);
+		if (memory == NULL)
+			return false;
+		stream->memory = memory;
+		stream->capacity = capacity;
+	}
+	memcpy(stream->memory + stream->size, data, size);
+	stream->size += size;
+	return true;
+}
+
+static void PutU32BE(u8 *dest, u32 value)
+{
+	dest[0] = (u8)(value >> 24);
+	dest[1] = (u8)(value >> 16);
+	dest[2] = (u8)(value >> 8);
+	dest[3] = (u8)value;
+}
+
+// backbuffer rows are stored bottom-up, ppm and png want them top-down
+static u32 *GetRow(Backbuffer *buffer, s32 y)
+{
+	return (u32 *)buffer->memory + (s64)(buffer->height - 1 - y) * buffer->width;
+}
+
+static void ConvertRow(u8 *dest, u32 *source, s32 width)
+{
+	for (s32 x = 0; x < width; x++) {
+		u32 pixel = source[x];
+		dest[x * 3 + 0] = (u8)(pixel >> 16);
+		dest[x * 3 + 1] = (u8)(pixel >> 8);
+		dest[x * 3 + 2] = (u8)pixel;
+	}
+}
+
+static b32 WriteTGA(OutputStream *output, Backbuffer *buffer)
+{
+	u8 header[18] = { 0 };
+	header[2] = 2;
+	header[12] = buffer->width & 0xFF;
+	header[13] = (buffer->width >> 8) & 0xFF;
+	header[14] = buffer->height & 0xFF;
+	header[15] = (buffer->height >> 8) & 0xFF;
+	header[16] = 32;
+
+	// the backbuffer is already bottom-up bgrx, so the pixels go out untouched
+	size_t size = (size_t)buffer->width * buffer->height * sizeof(u32);
+	return Put(output, header, sizeof(header)) && Put(output, buffer->memory, size);
+}
+
+static b32 WritePPM(OutputStream *output, Backbuffer *buffer)
+{
+	size_t row_size = (size_t)buffer->width * 3;
+	size_t mark = ArenaMark(&buffer->scratch);
+	u8 *row = PushArray(&buffer->scratch, u8, row_size);
+	char header[64];
+	s32 header_size = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", buffer->width, buffer->height);
+	b32 written = Put(output, header, header_size);
+
+	for (s32 y = 0; written && y < buffer->height; y++) {
+		ConvertRow(row, GetRow(buffer, y), buffer->width);
+		written = Put(output, row, row_size);
+	}
+
+	ArenaRestore(&buffer->scratch, mark);
+	return written;
+}
+
+typedef struct PNGStream {
+	OutputStream *output;
+	u8 *out;
+	s64 out_size;
+	u64 bits;
+	s32 num_bits;
+	u32 adler;
+	b32 ok;
+} PNGStream;
+
+static void WriteChunk(PNGStream *stream, const char *type, u8 *data, u32 size)
+{
+	u8 length[4], crc[4];
+	PutU32BE(length, size);
+	PutU32BE(crc, UpdateCRC(UpdateCRC(0, (u8 *)type, 4), data, size));
+
+	stream->ok = stream->ok &&
+		Put(stream->output, length, 4) &&
+		Put(stream->output, type, 4) &&
+		Put(stream->output, data, size) &&
+		Put(stream->output, crc, 4);
+}
+
+static void PutBits(PNGStream *stream, u32 value, s32 count)
+{
+	stream->bits |= (u64)value << stream->num_bits;
+	stream->num_bits += count;
+	while (stream->num_bits >= 8) {
+		stream->out[stream->out_size++] = (u8)stream->bits;
+		stream->bits >>= 8;
+		stream->num_bits -= 8;
+	}
+}
+
+static void AlignBits(PNGStream *stream)
+{
+	if (stream->num_bits > 0)
+		PutBits(stream, 0, 8 - stream->num_bits);
+}
+
+static void PutSymbol(PNGStream *stream, s32 symbol)
+{
+	PutBits(stream, literal_codes[symbol], literal_lengths[symbol]);
+}
+
+// whatever whole bytes have been produced go out as one IDAT, leftover
+// bits carry into the next one
+static void FlushIDAT(PNGStream *stream)
+{
+	if (stream->out_size > 0)
+		WriteChunk(stream, "IDAT", stream->out, (u32)stream->out_size);
+	stream->out_size = 0;
+}
+
+static void DeflateStored(PNGStream *stream, u8 *data, s32 size, b32 last)
+{
+	while (size > 0) {
+		s32 block = min(size, 65535);
+		PutBits(stream, last && block == size, 1);
+		PutBits(stream, 0, 2);
+		AlignBits(stream);
+		PutBits(stream, block & 0xFFFF, 16);
+		PutBits(stream, ~block & 0xFFFF, 16);
+		memcpy(stream->out + stream->out_size, data, block);
+		stream->out_size += block;
+		data += block;
+		size -= block;
+	}
+}
+
+// lz77 restricted to a distance of one pixel: runs of equal pixels (the
+// background, mostly) become length codes, everything else is a literal
+static void DeflateFixed(PNGStream *stream, u8 *data, s32 size)
+{
+	s32 i = 0;
+	while (i < size) {
+		s32 length = 0;
+		if (i >= 3) {
+			s32 max_length = min(258, size - i);
+			while (length < max_length && data[i + length] == data[i + length - 3])
+				length++;
+		}
+
+		if (length >= 3) {
+			s32 index = length_symbols[length];
+			PutSymbol(stream, 257 + index);
+			PutBits(stream, length - length_base[index], length_extra[index]);
+			PutBits(stream, 8, 5); // distance code 2 (distance 3), bit-reversed
+			i += length;
+		} else {
+			PutSymbol(stream, data[i]);
+			i++;
+		}
+	}
+}
+
+static b32 WritePNG(OutputStream *output, Backbuffer *buffer, b32 compress)
+{
+	static const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	s32 row_size = buffer->width * 3 + 1;
+	size_t mark = ArenaMark(&buffer->scratch);
+	u8 *row = PushArray(&buffer->scratch, u8, row_size);
+	u8 header[13] = { 0 };
+
+	InitTables();
+
+	PNGStream stream = { 0 };
+	stream.output = output;
+	stream.out = PushArray(&buffer->scratch, u8, (size_t)row_size * 2 + 64);
+	stream.adler = 1;
+	stream.ok = Put(output, signature, sizeof(signature));
+
+	PutU32BE(header + 0, buffer->width);
+	PutU32BE(header + 4, buffer->height);
+	header[8] = 8; // bit depth
+	header[9] = 2; // rgb
+	WriteChunk(&stream, "IHDR", header, sizeof(header));
+
+	// zlib header, deflate with a 32k window
+	PutBits(&stream, 0x78, 8);
+	PutBits(&stream, 0x01, 8);
+	if (compress) {
+		PutBits(&stream, 1, 1); // final
+		PutBits(&stream, 1, 2); // fixed huffman
+	}
+
+	for (s32 y = 0; stream.ok && y < buffer->height; y++) {
+		row[0] = 0; // filter: none
+		ConvertRow(row + 1, GetRow(buffer, y), buffer->width);
+		stream.adler = UpdateAdler(stream.adler, row, row_size);
+
+		if (compress)
+			DeflateFixed(&stream, row, row_size);
+		else
+			DeflateStored(&stream, row, row_size, y == buffer->height - 1);
+		FlushIDAT(&stream);
+	}
+
+	if (compress)
+		PutSymbol(&stream, 256);
+	AlignBits(&stream);
+	PutU32BE(stream.out + stream.out_size, stream.adler);
+	stream.out_size += 4;
+	FlushIDAT(&stream);
+	WriteChunk(&stream, "IEND", NULL, 0);
+
+	ArenaRestore(&buffer->scratch, mark);
+	return stream.ok;
+}
+
+ImageFormat ImageFormatFromPath(const char *path)
+{
+	const char *extension = strrchr(path, '.');
+	if (strcmp(path, "-") == 0)
+		return IMAGE_FORMAT_PPM;
+	if (extension && (strcmp(extension, ".ppm") == 0 || strcmp(extension, ".PPM") == 0))
+		return IMAGE_FORMAT_PPM;
+	if (extension && (strcmp(extension, ".png") == 0 || strcmp(extension, ".PNG") == 0))
+		return IMAGE_FORMAT_PNG;
+	return IMAGE_FORMAT_TGA;
+}
+
+static b32 Encode(OutputStream *output, Backbuffer *buffer, ImageFormat format)
+{
+	switch (format) {
+		case IMAGE_FORMAT_TGA: return WriteTGA(output, buffer);
+		case IMAGE_FORMAT_PPM: return WritePPM(output, buffer);
+		case IMAGE_FORMAT_PNG: return WritePNG(output, buffer, 1);
+		case IMAGE_FORMAT_PNG_STORED: return WritePNG(output, buffer, 0);
+	}
+	return false;
+}
+
+b32 WriteBackbuffer(FILE *file, Backbuffer *buffer, ImageFormat format)
+{
+	OutputStream output = { 0 };
+	output.file = file;
+	return Encode(&output, buffer, format);
+}
+
+u8 *EncodeBackbuffer(Backbuffer *buffer, ImageFormat format, s64 *size)
+{
+	OutputStream output = { 0 };
+	if (!Encode(&output, buffer, format)) {
+		free(output.memory);
+		return NULL;
+	}
+	*size = output.size;
+	return output.memory;
+}
+
+b32 WriteBackbufferFile(const char *file_name, Backbuffer *buffer, ImageFormat format)
+{
+	FILE *file = fopen(file_name, "wb");
+	if (file == NULL)
+		return false;
+
+	setvbuf(file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+	b32 written = WriteBackbuffer(file, buffer, format);
+	written = fclose(file) == 0 && written;
+
+	return written;
+}
+
+// the path goes to snprintf as the format, so it may hold nothing but the
+// frame number's conversion and %%
+static b32 IsFramePattern(const char *path)
+{
+	s32 conversions = 0;
+	for (const char *c = path; *c; c++) {
+		if (*c != '%')
+			continue;
+		if (c[1] == '%') {
+			c++;
+			continue;
+		}
+
+		// %d, or zero padded to at most two digits of width
+		s32 width = 0;
+		if (c[1] == '0') {
+			c++;
+			while (c[1] >= '0' && c[1] <= '9') {
+				c++;
+				width++;
+			}
+		}
+		if (c[1] != 'd' || width > 2)
+			return false;
+		c++;
+		conversions++;
+	}
+	return conversions == 1;
+}
+
+void OpenImageWriter(ImageWriter *writer, const char *path, ImageFormat format)
+{
+	memset(writer, 0, sizeof(ImageWriter));
+	writer->path = path;
+	writer->numbered = IsFramePattern(path);
+	writer->format = format;
+
+	// every frame goes down the same pipe, e.g. into ffmpeg -f image2pipe
+	if (strcmp(path, "-") == 0) {
+		writer->stream = stdout;
+		_setmode(_fileno(stdout), _O_BINARY);
+		setvbuf(stdout, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+	}
+}
+
+void CloseImageWriter(ImageWriter *writer)
+{
+	if (writer->stream)
+		fflush(writer->stream);
+}
+
+b32 WriteFrame(ImageWriter *writer, Backbuffer *buffer, s64 frame)
+{
+	b32 written;
+
+	if (writer->stream) {
+		written = WriteBackbuffer(writer->stream, buffer, writer->format);
+	} else {
+		char file_name[512];
+		const char *extension = strrchr(writer->path, '.');
+		s32 stem = extension ? (s32)(extension - writer->path) : (s32)strlen(writer->path);
+		if (writer->numbered)
+			snprintf(file_name, sizeof(file_name), writer->path, (s32)frame);
+		else if (strchr(writer->path, '%'))
+			snprintf(file_name, sizeof(file_name), "%.*s%06d%s", stem, writer->path, (s32)frame, extension ? extension : "");
+		else
+			snprintf(file_name, sizeof(file_name), "%s", writer->path);
+		written = WriteBackbufferFile(file_name, buffer, writer->format);
+	}
+
+	if (written)
+		writer->frames_written++;
+	return written;
+}
+
+void PresentToWriter(Backbuffer *buffer, s64 frame, void *user_data)
+{
+	WriteFrame((ImageWriter *)user_data, buffer, frame);
+}
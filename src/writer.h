@@ -0,0 +1,40 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+
+#include "types.h"
+#include "backbuffer.h"
+
+typedef enum ImageFormat {
+	IMAGE_FORMAT_TGA,
+	IMAGE_FORMAT_PPM,
+	IMAGE_FORMAT_PNG,        // fixed huffman, pixel run matches only
+	IMAGE_FORMAT_PNG_STORED, // uncompressed deflate blocks
+} ImageFormat;
+
+typedef struct ImageWriter {
+	const char *path; // file name, pattern with one %d or %0Nd for the frame number, or "-" for stdout
+	b32 numbered; // path is such a pattern
+	ImageFormat format;
+	FILE *stream;
+	s64 frames_written;
+} ImageWriter;
+
+ImageFormat ImageFormatFromPath(const char *path);
+
+b32 WriteBackbuffer(FILE *file, Backbuffer *buffer, ImageFormat format);
+b32 WriteBackbufferFile(const char *file_name, Backbuffer *buffer, ImageFormat format);
+// the encoded file as one malloc block the caller frees, NULL on failure
+u8 *EncodeBackbuffer(Backbuffer *buffer, ImageFormat format, s64 *size);
+
+// a path with any other % in it than the frame number's and %% is taken
+// as a plain name, with the frame number put before its extension
+void OpenImageWriter(ImageWriter *writer, const char *path, ImageFormat format);
+void CloseImageWriter(ImageWriter *writer);
+b32 WriteFrame(ImageWriter *writer, Backbuffer *buffer, s64 frame);
+
+// PresentFunc for a FrameRing, moves encoding and disk io off the render thread
+void PresentToWriter(Backbuffer *buffer, s64 frame, void *user_data);
+
+#endif